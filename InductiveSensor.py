@@ -4,6 +4,10 @@
 Displays resolver sine and cosine signals along with the calculated
 angle using Tkinter and matplotlib. If pyX2Cscope is unavailable, runs
 in Demo Mode with synthesised data.
+
+Samples are acquired by a background ``AcquisitionEngine`` and the plot
+is refreshed at a fixed frame rate by blitting, so the display rate does
+not depend on how fast the resolver is polled.
 """
 
 from __future__ import annotations
@@ -11,6 +15,7 @@ from __future__ import annotations
 import math
 import sys
 import time
+from collections import deque
 from dataclasses import dataclass
 from typing import Optional
 
@@ -30,6 +35,8 @@ except Exception:  # pragma: no cover - missing dependency
 
 import serial.tools.list_ports
 
+from scope_common import AcquisitionEngine, BlockReader, connect_scope
+
 
 @dataclass
 class _DemoSource:
@@ -61,37 +68,51 @@ class _ScopeWrapper:
         self.sin = None
         self.cos = None
         self.ang = None
+        self._reader: Optional[BlockReader] = None
         self.demo_src = _DemoSource()
 
     def connect(self, port: str, elf: str) -> None:
         if X2CScope is None:
             self.demo = True
             return
-        self.scope = X2CScope(port=port)
-        self.scope.import_variables(elf)
-        self.sin = self.scope.get_variable("sin_calibrated")
-        self.cos = self.scope.get_variable("cos_calibrated")
-        self.ang = self.scope.get_variable("resolver_position")
+        self.scope = connect_scope(port, elf)
+        # One merged RAM read per poll instead of three round-trips
+        self._reader = self.read_block(["sin_calibrated", "cos_calibrated", "resolver_position"])
+        self.sin, self.cos, self.ang = self._reader.variables
         self.demo = False
 
     def disconnect(self) -> None:
         if self.scope is not None:
             self.scope.disconnect()
         self.scope = None
+        self._reader = None
         self.demo = X2CScope is None
 
+    def read_block(self, names: list[str]) -> BlockReader:
+        """Reader fetching ``names`` with merged X2Cscope RAM requests.
+
+        Keep the returned reader and call ``read()`` on each poll; the
+        variables are looked up and the address plan computed only once.
+        """
+        if self.scope is None:
+            raise RuntimeError("Scope not connected")
+        return BlockReader([self.scope.get_variable(n) for n in names])
+
     def read(self) -> tuple[float, float, float]:
-        if self.demo or self.scope is None:
+        if self.demo or self._reader is None:
             return self.demo_src.read()
-        return (
-            float(self.sin.get_value()),  # type: ignore[call-arg]
-            float(self.cos.get_value()),  # type: ignore[call-arg]
-            float(self.ang.get_value()),  # type: ignore[call-arg]
-        )
+        s, c, ang = self._reader.read()
+        return float(s), float(c), float(ang)
 
 
 class InductiveSensorDemoTk:
-    DT_MS = 20
+    # Acquisition runs in the engine thread as fast as the link allows (at
+    # most one read per ACQ_PERIOD_S); the plot is refreshed at its own frame
+    # rate by blitting only the three lines onto a cached background.
+    ACQ_PERIOD_S = 0.001
+    FRAME_MS = 33
+    WINDOW_S = 5.0                      # visible history
+    HISTORY_SAMPLES = 10000             # ring size, bounds memory and draw cost
 
     def __init__(self) -> None:
         if plt is None:
@@ -107,6 +128,13 @@ class InductiveSensorDemoTk:
         self.prev_ang: Optional[float] = None
         self.turns = 0.0
 
+        self._samples: deque = deque(maxlen=self.HISTORY_SAMPLES)
+        self._engine = AcquisitionEngine(self._scope.read, self.ACQ_PERIOD_S,
+                                         maxsize=self.HISTORY_SAMPLES)
+        self._last_ang = 0.0
+        self._rpm_ref: tuple[float, float] = (0.0, 0.0)  # (time, turns) of last frame
+        self._bg = None
+
         self._build_ui()
         self._after_id: Optional[str] = None
 
@@ -139,11 +167,17 @@ class InductiveSensorDemoTk:
         ax.set_xlabel("Time (s)")
         ax.set_ylabel("Value")
         ax.grid(True)
+        # Fixed axes (time relative to the newest sample) keep the background
+        # valid between frames; the limits only change when data leaves them.
+        ax.set_xlim(-self.WINDOW_S, 0.0)
+        ax.set_ylim(-1.1, 1.1)
         self._ax = ax
-        (self.line_sin,) = ax.plot([], [], label="Sine", color="b")
-        (self.line_cos,) = ax.plot([], [], label="Cosine", color="g")
-        (self.line_ang,) = ax.plot([], [], label="Angle/π", color="hotpink")
+        (self.line_sin,) = ax.plot([], [], label="Sine", color="b", animated=True)
+        (self.line_cos,) = ax.plot([], [], label="Cosine", color="g", animated=True)
+        (self.line_ang,) = ax.plot([], [], label="Angle/π", color="hotpink", animated=True)
+        self._lines = (self.line_sin, self.line_cos, self.line_ang)
         ax.legend()
+        self.canvas.mpl_connect("draw_event", self._on_draw)
 
         info = ttk.Frame(main)
         info.pack(fill="x")
@@ -154,11 +188,6 @@ class InductiveSensorDemoTk:
             w.pack(side="left", padx=6)
         info.pack_propagate(False)
 
-        self.data_t: list[float] = []
-        self.data_sin: list[float] = []
-        self.data_cos: list[float] = []
-        self.data_ang: list[float] = []
-
     # ------------------------------------------------------------- utilities --
     @staticmethod
     def _ports() -> list[str]:
@@ -189,6 +218,10 @@ class InductiveSensorDemoTk:
         if not port or port == "-" or not elf:
             messagebox.showwarning("Missing", "Choose COM port and ELF file")
             return
+        if self._engine.running:
+            # The previous session's thread is still inside a read
+            messagebox.showwarning("Link busy", "The previous connection is still closing, try again")
+            return
         try:
             self._scope.connect(port, elf)
         except Exception as e:  # pragma: no cover - hardware errors
@@ -199,64 +232,102 @@ class InductiveSensorDemoTk:
         self.t0 = time.perf_counter()
         self.prev_ang = None
         self.turns = 0.0
-        self.data_t.clear()
-        self.data_sin.clear()
-        self.data_cos.clear()
-        self.data_ang.clear()
+        self._rpm_ref = (0.0, 0.0)
+        self._samples.clear()
+        self._engine.drain()
+        if not self._engine.start():
+            self._disconnect()
+            messagebox.showwarning("Link busy", "The previous connection is still closing, try again")
+            return
         self._schedule_update()
 
     def _disconnect(self) -> None:
         if self._after_id is not None:
             self.root.after_cancel(self._after_id)
             self._after_id = None
-        self._scope.disconnect()
         self.connected = False
-        self.conn_btn.config(text="Connect")
+        self.conn_btn.config(text="Connect", state="disabled")
+        self._close_when_idle(timeout=0.2)
+
+    def _close_when_idle(self, timeout: float = 0.0) -> None:
+        """Close the port once the acquisition thread has left its last read."""
+        if not self._engine.stop(timeout):
+            self.root.after(self.FRAME_MS, self._close_when_idle)
+            return
+        self._scope.disconnect()
+        self.conn_btn.config(state="normal")
+
+    # ---------------------------------------------------------- acquisition --
+    def _consume(self) -> None:
+        """Move new engine samples into the plot ring and track the angle."""
+        for t, (s, c, ang) in self._engine.drain():
+            now = t - self.t0
+            if self.prev_ang is not None:
+                delta = ang - self.prev_ang
+                if delta > math.pi:
+                    delta -= 2 * math.pi
+                elif delta < -math.pi:
+                    delta += 2 * math.pi
+                self.turns += delta / (2 * math.pi)
+            self.prev_ang = ang
+            self._samples.append((now, s, c, ang / math.pi))
+            self._last_ang = ang
 
     # --------------------------------------------------------------- update ---
     def _schedule_update(self) -> None:
-        self._after_id = self.root.after(self.DT_MS, self._update)
-
-    def _update(self) -> None:
-        s, c, ang = self._scope.read()
-        now = time.perf_counter() - self.t0
+        self._after_id = self.root.after(self.FRAME_MS, self._update)
 
-        if self.prev_ang is None:
-            rpm = 0.0
-        else:
-            delta = ang - self.prev_ang
-            if delta > math.pi:
-                delta -= 2 * math.pi
-            elif delta < -math.pi:
-                delta += 2 * math.pi
-            self.turns += delta / (2 * math.pi)
-            rpm = delta / (self.DT_MS / 1000.0) * 60 / (2 * math.pi)
-        self.prev_ang = ang
-
-        self.data_t.append(now)
-        self.data_sin.append(s)
-        self.data_cos.append(c)
-        self.data_ang.append(ang / math.pi)
-        if len(self.data_t) > 1000:
-            self.data_t.pop(0)
-            self.data_sin.pop(0)
-            self.data_cos.pop(0)
-            self.data_ang.pop(0)
-
-        self.line_sin.set_data(self.data_t, self.data_sin)
-        self.line_cos.set_data(self.data_t, self.data_cos)
-        self.line_ang.set_data(self.data_t, self.data_ang)
-        self._ax.relim()
-        self._ax.autoscale_view()
-        self.canvas.draw()
-
-        self.lbl_angle.config(text=f"Angle: {math.degrees(ang):.1f}°")
-        self.lbl_speed.config(text=f"Speed: {rpm:.1f} RPM")
-        self.lbl_turns.config(text=f"Turns: {self.turns:.2f}")
+    def _on_draw(self, _event) -> None:
+        """Full redraw happened (resize, new limits): refresh the background."""
+        self._bg = self.canvas.copy_from_bbox(self._ax.bbox)
+        for line in self._lines:
+            self._ax.draw_artist(line)
 
+    def _update(self) -> None:
+        self._consume()
+        snap = list(self._samples)
+
+        if snap:
+            t_end = snap[-1][0]
+            start = 0
+            while start < len(snap) and snap[start][0] < t_end - self.WINDOW_S:
+                start += 1
+            snap = snap[start:]
+            ts = [p[0] - t_end for p in snap]
+            cols = list(zip(*snap))[1:]
+            for line, ys in zip(self._lines, cols):
+                line.set_data(ts, ys)
+            self._render(min(min(c) for c in cols), max(max(c) for c in cols))
+
+            t_ref, turns_ref = self._rpm_ref
+            turns = self.turns
+            dt = t_end - t_ref
+            rpm = (turns - turns_ref) / dt * 60.0 if t_ref and dt > 0 else 0.0
+            self._rpm_ref = (t_end, turns)
+
+            self.lbl_angle.config(text=f"Angle: {math.degrees(self._last_ang):.1f}°")
+            self.lbl_speed.config(text=f"Speed: {rpm:.1f} RPM")
+            self.lbl_turns.config(text=f"Turns: {turns:.2f}")
+
+        if self._engine.error is not None:
+            messagebox.showerror("Connection", f"Acquisition stopped: {self._engine.error}")
+            self._disconnect()
         if self.connected:
             self._schedule_update()
 
+    def _render(self, lo: float, hi: float) -> None:
+        """Blit the lines; fall back to a full draw when the y range grew."""
+        y0, y1 = self._ax.get_ylim()
+        if self._bg is None or lo < y0 or hi > y1:
+            margin = 0.1 * max(hi - lo, 1e-3)
+            self._ax.set_ylim(min(y0, lo - margin), max(y1, hi + margin))
+            self.canvas.draw()              # _on_draw caches the new background
+            return
+        self.canvas.restore_region(self._bg)
+        for line in self._lines:
+            self._ax.draw_artist(line)
+        self.canvas.blit(self._ax.bbox)
+
 
 def main() -> None:
     demo = InductiveSensorDemoTk()
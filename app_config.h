@@ -0,0 +1,189 @@
+/*******************************************************************************
+  Application Configuration Header
+
+  File Name:
+    app_config.h
+
+  Summary:
+    Compile-time configuration of the temperature demo in main_temp.c.
+
+  Description:
+    Buffer sizes, sensor addresses, sampling periods and the feature switches
+    that select which optional paths are built. Each switch can be overridden
+    from the compiler command line, e.g. -DAPP_LOG_BACKEND=APP_LOG_BACKEND_NONE
+    for a production build that only talks to X2Cscope.
+ *******************************************************************************/
+
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Feature Switches
+// *****************************************************************************
+// *****************************************************************************
+
+// Destination of the temperature log (ASCII lines and binary frames)
+#define APP_LOG_BACKEND_NONE                    0   // Not built
+#define APP_LOG_BACKEND_UART                    1   // DMA to LOG_USART_REGS
+#define APP_LOG_BACKEND_RING                    2   // logRing, read through X2Cscope
+#ifndef APP_LOG_BACKEND
+#if defined(APP_UART_LOG_ENABLE) && (APP_UART_LOG_ENABLE == 0)
+#define APP_LOG_BACKEND                         APP_LOG_BACKEND_NONE
+#else
+#define APP_LOG_BACKEND                         APP_LOG_BACKEND_UART
+#endif
+#endif
+#define APP_LOG_ENABLE                          (APP_LOG_BACKEND != APP_LOG_BACKEND_NONE)
+
+// Toggle LED1 on every reported sample
+#ifndef APP_LED_TOGGLE_ENABLE
+#define APP_LED_TOGGLE_ENABLE                   1
+#endif
+
+// Sample history ring for block reads over X2Cscope
+#ifndef APP_SAMPLE_HISTORY_ENABLE
+#define APP_SAMPLE_HISTORY_ENABLE               1
+#endif
+
+// Cycle-count profiling of the ISRs and the main loop
+#ifndef APP_PROFILING_ENABLE
+#define APP_PROFILING_ENABLE                    1
+#endif
+
+// IDLE sleep when the main loop has nothing to do
+#ifndef APP_LOW_POWER_ENABLE
+#define APP_LOW_POWER_ENABLE                    1
+#endif
+
+// Triggered capture with pre-trigger ring on the 1 ms tick
+#ifndef APP_TRIGGER_ENABLE
+#define APP_TRIGGER_ENABLE                      1
+#endif
+
+// Long-run statistics of the temperature and sample interval (stats)
+#ifndef APP_STATS_ENABLE
+#define APP_STATS_ENABLE                        1
+#endif
+
+// Sensor reads as one DMA transfer; off by default because it needs the
+// I2C_DMA_CHANNEL configured in MCC
+#ifndef APP_I2C_DMA_ENABLE
+#define APP_I2C_DMA_ENABLE                      0
+#endif
+
+// Configuration stored in the RWW EEPROM and restored at boot
+#ifndef APP_SETTINGS_ENABLE
+#define APP_SETTINGS_ENABLE                     1
+#endif
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Sizes and Periods
+// *****************************************************************************
+// *****************************************************************************
+
+// Define the I2C address for the temperature sensor
+#define TEMP_SENSOR_SLAVE_ADDR                  0x004F
+// Define the register address for the temperature sensor
+#define TEMP_SENSOR_REG_ADDR                    0x00
+// Valid bits of the left-aligned temperature word (9-bit, 0.5 C per LSB)
+#define TEMP_SENSOR_DATA_MASK                   0xFF80U
+
+// Upper limit of back-to-back reads per sensor and sample period
+#define TEMP_OVERSAMPLE_MAX                     8U
+// Output filter coefficient in Q15, 32768 passes the input through
+#define TEMP_FILTER_ALPHA_ONE                   32768U
+
+// I2C error handling: immediate retries per sensor and read, and the cap of
+// the back-off (a failing sensor is skipped for up to 2^n - 1 scans)
+#define I2C_RETRY_LIMIT                         1U
+#define I2C_BACKOFF_MAX_SHIFT                   4U
+// Consecutive RTC matches that may find a scan still running before its
+// transfer is taken as hung (SCL held low without a bus error) and the bus
+// is recovered
+#define I2C_STALL_MATCHES                       4U
+// SERCOM2 pins taken over as GPIO for bus recovery; must match the MCC pin
+// configuration
+#define I2C_SDA_PIN                             PORT_PIN_PA08
+#define I2C_SCL_PIN                             PORT_PIN_PA09
+#define I2C_PIN_FUNCTION                        PERIPHERAL_FUNCTION_D
+// Half SCL period of the recovery clock (about 100 kHz)
+#define I2C_RECOVERY_HALF_PERIOD_CYCLES         (CPU_CLOCK_FREQUENCY / 200000U)
+// DMA channel of the sensor reads (SERCOM2 RX trigger, byte beats, fixed
+// source, incrementing destination) and the 1 ms ticks after which a read
+// that never completed is aborted
+#define I2C_DMA_CHANNEL                         DMAC_CHANNEL_1
+#define I2C_DMA_TIMEOUT_TICKS                   3U
+// NVIC priority given to the DMAC, SERCOM2, TC0 and RTC interrupts with
+// APP_I2C_DMA_ENABLE; all of them reach the I2C state machine and must not
+// preempt each other. Priority 3 is the MCC default.
+#define I2C_IRQ_PRIORITY                        3U
+
+// UART transmit queue: number of message slots (power of two) and slot size;
+// the slot size is also the longest log record
+#define UART_TX_QUEUE_DEPTH                     4U
+#define UART_TX_BUFFER_SIZE                     48U
+// USART and DMA channel of the UART log backend. SERCOM1 is also the X2Cscope
+// link; a second SERCOM (e.g. SERCOM3) needs its USART and a DMA channel with
+// its TX trigger configured in MCC.
+#define LOG_USART_REGS                          SERCOM1_REGS
+#define LOG_DMA_CHANNEL                         DMAC_CHANNEL_0
+// Bytes in the X2Cscope-readable log ring of the ring backend (power of two)
+#define LOG_RING_SIZE                           512U
+
+// Binary telemetry frame: sync, sequence, RTC timestamp, raw sensor word,
+// sampling rate and CRC-16, multi-byte fields little endian
+#define TELEMETRY_FRAME_SYNC                    0xA5U
+#define TELEMETRY_FRAME_SIZE                    11U
+
+// Number of entries in the sample history ring (power of two)
+#define SAMPLE_HISTORY_DEPTH                    64U
+
+// USART used by X2Cscope for the host link
+#define X2CSCOPE_USART_REGS                     SERCOM1_REGS
+#define X2CSCOPE_USART_IRQn                     SERCOM1_IRQn
+#define X2CSCOPE_USART_SERIAL_SETUP             SERCOM1_USART_SerialSetup
+// Baud rate after reset; the host can switch to any entry of x2cscopeBaudRates[]
+#define X2CSCOPE_BAUD_DEFAULT                   115200U
+// Upper bound of X2Cscope_Communicate() calls per main loop pass while the
+// host link is busy
+#define X2CSCOPE_SERVICE_BURST                  64U
+// Stay awake this many 1 ms ticks after X2Cscope traffic, the response is
+// clocked out from X2Cscope_Communicate() and must not wait for a wake-up
+#define X2CSCOPE_AWAKE_TICKS                    20U
+
+// RWW EEPROM area of the settings records. Each commit goes to the next
+// page; the rows are erased in turn, so the latest record survives an erase.
+#define SETTINGS_NVM_ADDRESS                    NVMCTRL_RWWEEPROM_START_ADDRESS
+#define SETTINGS_NVM_ROWS                       2U
+
+// Number of pending events between the interrupt handlers and main() (power of two)
+#define APP_EVENT_QUEUE_DEPTH                   16U
+// Completed scans waiting for main() (power of two)
+#define I2C_SCAN_RESULT_DEPTH                   4U
+
+// Samples in the triggered capture window, pre- plus post-trigger (power of two)
+#define TRIGGER_BUFFER_DEPTH                    256U
+
+// SysTick runs free as a 24-bit down counter at the CPU clock for profiling
+// and short delays
+#define PROFILE_COUNTER_MASK                    0x00FFFFFFU
+// Weight of a new measurement in the running average (1 / 2^n)
+#define PROFILE_AVERAGE_SHIFT                   4U
+
+/* RTC Time period match values for input clock of 1 KHz */
+#define PERIOD_500MS                            512 // 0x200 in hexadecimal (default value in MCC)
+#define PERIOD_1S                               1024
+#define PERIOD_2S                               2048
+#define PERIOD_4S                               4096
+#define RTC_CLOCK_HZ                            1024U
+// Period range accepted from the host (about 10 ms to 68 minutes)
+#define PERIOD_MIN                              10U
+#define PERIOD_MAX                              0x400000U
+
+#endif // APP_CONFIG_H
+
+/*******************************************************************************
+ End of File
+*/
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Benchmark the X2Cscope link to a board running ``main_temp.c``.
+
+Measures, at the board's current baud rate or the one given with
+``--baud``:
+
+* round-trip latency of single-variable reads (percentiles) and reads/s,
+* the same for a ``BlockReader`` over the ``telemetry`` struct,
+* sustained scope-channel throughput (samples/s),
+* bytes/s on the serial port when the pyX2Cscope interface exposes it,
+* the firmware's ``linkStats`` counters over the run (main loop passes,
+  ``X2Cscope_Communicate()`` calls, host bytes served, sleeps).
+
+Run it before and after a change to quantify the difference::
+
+    python bench_link.py COM5 firmware.elf --reads 500
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import statistics
+import time
+from typing import Any, Callable, Dict, List, Optional
+
+from scope_common import LINK_BAUD_RATES, BlockReader, connect_scope, find_serial_port, set_link_baud
+
+TELEMETRY_MEMBERS = (
+    "telemetry.version", "telemetry.sampleRate", "telemetry.temperature",
+    "telemetry.temperatureQ8", "telemetry.filteredQ8", "telemetry.timestamp",
+    "telemetry.samplePeriod", "telemetry.sampleCount",
+)
+LINK_STATS = ("loopIterations", "communicateCalls", "rxBytes", "idleEntries")
+
+
+class _ByteCounter:
+    """Count bytes through the pyserial port behind the scope, if reachable."""
+
+    def __init__(self, scope: Any) -> None:
+        self.rx = 0
+        self.tx = 0
+        self.port = find_serial_port(scope)
+        if self.port is not None:
+            read, write = self.port.read, self.port.write
+
+            def _read(*a, **kw):
+                data = read(*a, **kw)
+                self.rx += len(data)
+                return data
+
+            def _write(data, *a, **kw):
+                self.tx += len(data)
+                return write(data, *a, **kw)
+
+            self.port.read, self.port.write = _read, _write
+
+    def snapshot(self) -> tuple[int, int]:
+        return self.rx, self.tx
+
+
+def _latency(fn: Callable[[], Any], count: int) -> Dict[str, float]:
+    times: List[float] = []
+    start = time.perf_counter()
+    for _ in range(count):
+        t0 = time.perf_counter()
+        fn()
+        times.append(time.perf_counter() - t0)
+    elapsed = time.perf_counter() - start
+    q = statistics.quantiles(times * (2 if len(times) == 1 else 1), n=100)
+    return {
+        "p50_ms": q[49] * 1e3,
+        "p90_ms": q[89] * 1e3,
+        "p99_ms": q[98] * 1e3,
+        "max_ms": max(times) * 1e3,
+        "per_s": count / elapsed,
+    }
+
+
+def _scope_throughput(scope: Any, var: Any, seconds: float) -> Optional[Dict[str, float]]:
+    """Samples/s through the scope channel, same calls as motorlogger."""
+    if not hasattr(scope, "add_scope_channel"):
+        return None
+    for name in ("clear_scope_channels", "clear_all_scope_channel", "clear_all_scope_channels"):
+        if hasattr(scope, name):
+            getattr(scope, name)()
+            break
+    scope.add_scope_channel(var)
+    scope.set_sample_time(1)
+    scope.request_scope_data()
+    samples = 0
+    blocks = 0
+    end = time.perf_counter() + seconds
+    start = time.perf_counter()
+    while time.perf_counter() < end:
+        if scope.is_scope_data_ready():
+            data = scope.get_scope_channel_data(valid_data=False)
+            scope.request_scope_data()
+            samples += sum(len(v) for v in data.values())
+            blocks += 1
+        else:
+            time.sleep(0.001)
+    elapsed = time.perf_counter() - start
+    return {"samples_per_s": samples / elapsed, "blocks_per_s": blocks / elapsed}
+
+
+def _link_stats(scope: Any) -> Optional[Dict[str, int]]:
+    try:
+        vars_ = [scope.get_variable(f"linkStats.{n}") for n in LINK_STATS]
+    except Exception:
+        return None
+    if None in vars_:
+        return None
+    return dict(zip(LINK_STATS, BlockReader(vars_).read()))
+
+
+def run(port: str, elf: str, reads: int, scope_s: float, baud: Optional[int] = None) -> Dict[str, Any]:
+    scope = connect_scope(port, elf)
+    try:
+        if baud is not None:
+            set_link_baud(scope, baud)
+        counter = _ByteCounter(scope)
+        result: Dict[str, Any] = {}
+        stats0 = _link_stats(scope)
+        t0 = time.perf_counter()
+        rx0, tx0 = counter.snapshot()
+
+        single = scope.get_variable("TemperatureValueX2C")
+        result["single_read"] = _latency(single.get_value, reads)
+
+        members = [scope.get_variable(n) for n in TELEMETRY_MEMBERS]
+        if None not in members:
+            reader = BlockReader(members)
+            block = _latency(reader.read, reads)
+            block["transactions"] = reader.transactions
+            block["variables"] = len(members)
+            result["block_read"] = block
+
+        rx1, tx1 = counter.snapshot()
+        elapsed = time.perf_counter() - t0
+        if counter.port is not None:
+            result["serial"] = {"rx_bytes_per_s": (rx1 - rx0) / elapsed,
+                                "tx_bytes_per_s": (tx1 - tx0) / elapsed}
+
+        stats1 = _link_stats(scope)
+        if stats0 is not None and stats1 is not None:
+            result["firmware_per_s"] = {k: ((stats1[k] - stats0[k]) & 0xFFFFFFFF) / elapsed
+                                        for k in LINK_STATS}
+
+        if scope_s > 0:
+            var = scope.get_variable("TemperatureQ8X2C")
+            result["scope"] = _scope_throughput(scope, var, scope_s)
+        return result
+    finally:
+        scope.disconnect()
+
+
+def _print(result: Dict[str, Any]) -> None:
+    for section, values in result.items():
+        if not values:
+            continue
+        print(f"[{section}]")
+        for k, v in values.items():
+            print(f"  {k:18s} {v:12.3f}" if isinstance(v, float) else f"  {k:18s} {v:12}")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("port")
+    ap.add_argument("elf")
+    ap.add_argument("--reads", type=int, default=200, help="reads per latency test")
+    ap.add_argument("--scope-seconds", type=float, default=5.0,
+                    help="duration of the scope throughput test, 0 to skip")
+    ap.add_argument("--json", action="store_true", help="print the result as JSON")
+    ap.add_argument("--baud", type=int, choices=LINK_BAUD_RATES,
+                    help="switch the link to this rate before measuring")
+    args = ap.parse_args()
+
+    result = run(args.port, args.elf, args.reads, args.scope_seconds, args.baud)
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        _print(result)
+
+
+if __name__ == "__main__":
+    main()
@@ -22,103 +22,2005 @@
 // *****************************************************************************
 // *****************************************************************************
 
-#include <string.h>                     // For string manipulation functions
-#include <stdio.h>                      // For standard input/output functions
+#include <string.h>                     // For memcpy
 
 #include <stddef.h>                     // Defines NULL
 #include <stdbool.h>                    // Defines true and false
 #include <stdlib.h>                     // Defines EXIT_FAILURE
 #include "definitions.h"                // SYS function prototypes
+#include "app_config.h"                 // Application sizes, periods and feature switches
 
-// Define the I2C address for the temperature sensor
-#define TEMP_SENSOR_SLAVE_ADDR                  0x004F
-// Define the register address for the temperature sensor
-#define TEMP_SENSOR_REG_ADDR                    0x00
 
-/* RTC Time period match values for input clock of 1 KHz */
-#define PERIOD_500MS                            512 // 0x200 in hexadecimal (default value in MCC)
-#define PERIOD_1S                               1024
-#define PERIOD_2S                               2048
-#define PERIOD_4S                               4096
+// Enumeration for temperature sampling rates
+typedef enum
+{
+    TEMP_SAMPLING_RATE_500MS = 0,
+    TEMP_SAMPLING_RATE_1S = 1,
+    TEMP_SAMPLING_RATE_2S = 2,
+    TEMP_SAMPLING_RATE_4S = 3,
+    TEMP_SAMPLING_RATE_COUNT = 4,
+    // Period written by the host through tempSamplePeriod
+    TEMP_SAMPLING_RATE_CUSTOM = TEMP_SAMPLING_RATE_COUNT,
+} TEMP_SAMPLING_RATE;
+
+// Initialize the temperature sampling rate to 500ms
+static TEMP_SAMPLING_RATE tempSampleRate = TEMP_SAMPLING_RATE_500MS;
+
+// Sampling period in RTC ticks (1/1024 s). Written by the host through
+// X2Cscope to select any period, updated by the firmware on a button press.
+// A new period takes effect at the end of the current one.
+static volatile uint32_t tempSamplePeriod = PERIOD_500MS;
+// Period handed to the RTC handler and the one the RTC runs with. The
+// compare value only changes at a match, while the counter is near zero.
+static volatile uint32_t tempSamplePeriodPending = PERIOD_500MS;
+static volatile uint32_t tempSamplePeriodApplied = PERIOD_500MS;
+
+#if APP_LOG_ENABLE
+// Format of the samples written to the log backend
+typedef enum
+{
+    TELEMETRY_MODE_ASCII = 0,
+    TELEMETRY_MODE_BINARY = 1,
+} TELEMETRY_MODE;
+
+// Selected from the host through X2Cscope, ASCII log by default
+static volatile TELEMETRY_MODE telemetryMode = TELEMETRY_MODE_ASCII;
+static uint8_t telemetrySequence = 0;
+#endif // APP_LOG_ENABLE
+
+// Report by exception, configured through X2Cscope. When enabled a sample is
+// only logged if it differs from the last reported one by at least
+// reportDeadbandQ8, or after reportHeartbeat samples without a report.
+// reportChangeCount counts the reported samples.
+static volatile bool reportByException = false;
+static volatile uint16_t reportDeadbandQ8 = 256;    // 1 C
+static volatile uint16_t reportHeartbeat = 60;
+static volatile uint32_t reportChangeCount = 0;
+static int16_t reportLastQ8 = 0;
+static uint16_t reportSilentSamples = 0;
+
+// Events posted by the interrupt handlers and dispatched by main()
+typedef enum
+{
+    APP_EVENT_RATE_CHANGE = 0,
+    APP_EVENT_TEMPERATURE_READ = 1,
+    APP_EVENT_UART_TX_ERROR = 2,
+    APP_EVENT_I2C_BUS_ERROR = 3,
+} APP_EVENT;
+
+// Event queue. Producers advance appEventHead, main() advances appEventTail;
+// both are free running, the slot is index % APP_EVENT_QUEUE_DEPTH.
+static volatile uint8_t appEventQueue[APP_EVENT_QUEUE_DEPTH];
+static volatile uint8_t appEventHead = 0;
+static volatile uint8_t appEventTail = 0;
+static volatile uint16_t appEventOverflows = 0;
+
+#if APP_PROFILING_ENABLE
+// Code sections measured by the profiler
+typedef enum
+{
+    PROFILE_SECTION_X2C_UPDATE = 0,     // TC0 1 ms callback
+    PROFILE_SECTION_I2C_HANDLER = 1,    // SERCOM2 I2C completion callback
+    PROFILE_SECTION_X2C_COMMUNICATE = 2,
+    PROFILE_SECTION_MAIN_LOOP = 3,      // One main loop pass (with ISR preemption), sleep excluded
+    PROFILE_SECTION_COUNT = 4,
+} PROFILE_SECTION_ID;
+
+// CPU cycles spent in one section
+typedef struct
+{
+    uint32_t min;
+    uint32_t max;
+    uint32_t avg;                       // Exponential running average
+    uint32_t count;
+} PROFILE_SECTION;
+
+// Read through X2Cscope; write profileReset = 1 to restart the statistics
+PROFILE_SECTION profile[PROFILE_SECTION_COUNT];
+volatile bool profileReset = true;
+#endif // APP_PROFILING_ENABLE
+
+#if APP_LOG_BACKEND == APP_LOG_BACKEND_UART
+// Set while no UART DMA transfer is in flight
+static volatile bool isUSARTTxComplete = true;
+#endif
+
+#if APP_LOW_POWER_ENABLE
+// Remaining 1 ms ticks before the main loop may sleep again
+static volatile uint8_t x2cscopeAwakeTicks = X2CSCOPE_AWAKE_TICKS;
+#endif // APP_LOW_POWER_ENABLE
+
+// Host link counters for benchmarking, read through X2Cscope; write
+// linkStatsReset = 1 to clear them. Only main() updates them.
+typedef struct
+{
+    uint32_t loopIterations;            // Main loop passes
+    uint32_t communicateCalls;          // X2Cscope_Communicate() calls
+    uint32_t rxBytes;                   // Host bytes taken by X2Cscope_Communicate()
+    uint32_t idleEntries;               // Times the core went to sleep
+} LINK_STATS;
+
+LINK_STATS linkStats;
+volatile bool linkStatsReset = false;
+
+// Host link baud rates the firmware accepts. The host writes one of them to
+// x2cscopeBaudRequest; it is applied once the acknowledge has left the
+// transmitter, after which the host reopens its port at the new rate.
+static const uint32_t x2cscopeBaudRates[] = { 115200U, 230400U, 460800U, 921600U };
+volatile uint32_t x2cscopeBaudRequest = X2CSCOPE_BAUD_DEFAULT;
+volatile uint32_t x2cscopeBaud = X2CSCOPE_BAUD_DEFAULT;
+
+// When the 1 ms TC0 tick feeds a sample to X2Cscope
+typedef enum
+{
+    X2CSCOPE_UPDATE_PERIODIC = 0,       // Every x2cscopePrescaler ticks
+    X2CSCOPE_UPDATE_ON_CHANGE = 1,      // Only after a new temperature sample
+} X2CSCOPE_UPDATE_MODE;
+
+// Written by the host through X2Cscope. The scope time base becomes
+// x2cscopePrescaler ms per sample in periodic mode.
+static volatile X2CSCOPE_UPDATE_MODE x2cscopeUpdateMode = X2CSCOPE_UPDATE_PERIODIC;
+static volatile uint16_t x2cscopePrescaler = 1;
+static uint16_t x2cscopePrescalerCount = 0;
+static volatile bool x2cscopeSampleRequest = false;
+
+// Define variables for temperature value and I2C data
+static uint8_t temperatureVal;
+static int16_t temperatureQ8;
+
+// Sensors read back to back on every RTC match. Entry 0 is the primary
+// sensor behind TemperatureValueX2C, the UART log and the sample history;
+// add an entry per extra sensor on the bus.
+typedef struct
+{
+    uint16_t address;
+    uint8_t reg;                        // Register written before the read
+} TEMP_SENSOR_CONFIG;
+
+static TEMP_SENSOR_CONFIG tempSensors[] =
+{
+    { TEMP_SENSOR_SLAVE_ADDR, TEMP_SENSOR_REG_ADDR },
+};
+
+#define TEMP_SENSOR_COUNT                       (sizeof(tempSensors) / sizeof(tempSensors[0]))
+
+// Raw words of the current scan, one per sensor
+static uint8_t i2cRdData[TEMP_SENSOR_COUNT][2] = {{0}};
+// Sensor being read and whether a scan is in progress
+static volatile uint8_t i2cJob = 0;
+static volatile bool i2cScanActive = false;
+// Oversampling: round of the current scan, rounds to do, and the running
+// Q8.8 sum and number of good reads per sensor
+static volatile uint8_t i2cRound = 0;
+static uint8_t i2cRounds = 1;
+static int32_t i2cSampleSum[TEMP_SENSOR_COUNT];
+static uint8_t i2cSampleCount[TEMP_SENSOR_COUNT];
+// Sample time of the first good read per sensor in the current scan
+static uint32_t i2cSampleTime[TEMP_SENSOR_COUNT];
+// RTC matches that found the previous scan still running
+static volatile uint32_t i2cMissedReads = 0;
+// Retries already spent on the current sensor
+static volatile uint8_t i2cAttempt = 0;
+
+// Outcome of one completed scan. The next scan starts at the next RTC match
+// and reuses the working buffers above, so i2cScanFinish() copies what
+// main() needs into a record of its own.
+typedef struct
+{
+    uint32_t timestamp;                 // Sample time of the primary sensor
+    uint32_t valid;                     // Sensors that answered, bit per sensor
+    int16_t tempQ8[TEMP_SENSOR_COUNT];  // Averaged Q8.8 value per sensor
+    uint8_t raw[2];                     // Last raw word of the primary sensor
+#if APP_STATS_ENABLE
+    bool irregular;                     // Interval before this scan was not one period
+    uint32_t period;                    // RTC period the scan was started with
+#endif
+} I2C_SCAN_RESULT;
+
+// Completed scans from the I2C and RTC handlers to main(). The handlers
+// advance i2cScanResultHead, main() advances i2cScanResultTail; a scan that
+// finds the ring full is dropped and counted in i2cScanOverruns.
+static I2C_SCAN_RESULT i2cScanResults[I2C_SCAN_RESULT_DEPTH];
+static volatile uint8_t i2cScanResultHead = 0;
+static volatile uint8_t i2cScanResultTail = 0;
+volatile uint32_t i2cScanOverruns = 0;
+// Sensors that answered in the scan main() published last
+static uint32_t appScanValid = 0;
+// Consecutive RTC matches that found the scan still running
+static uint8_t i2cStallMatches = 0;
+// Set from the bus error or stall until main() has recovered the bus; late
+// completions of the aborted scan are ignored meanwhile
+static volatile bool i2cRecoveryPending = false;
+
+#if APP_I2C_DMA_ENABLE
+// contextHandle of i2cEventHandler calls that finish a DMA read
+#define I2C_CONTEXT_DMA                         1U
+// Sensors whose register pointer is known to select the temperature
+// register; they are read without the register write, as one DMA transfer
+static bool i2cPointerValid[TEMP_SENSOR_COUNT];
+// 1 ms ticks left for the DMA read in flight, 0 when none is
+static volatile uint8_t i2cDmaTicks = 0;
+// Outcome of the last DMA read for i2cEventHandler
+static SERCOM_I2C_ERROR i2cDmaError = SERCOM_I2C_ERROR_NONE;
+#endif // APP_I2C_DMA_ENABLE
+
+// The RTC counter clears on every compare match, so it only counts within a
+// period. rtcEpoch accumulates the finished periods and together they give a
+// time base that runs monotonic across rate changes (1/RTC_CLOCK_HZ ticks).
+static volatile uint32_t rtcEpoch = 0;
+
+// Per-sensor failure tracking for the back-off
+typedef struct
+{
+    uint16_t failures;                  // Reads that failed after all retries
+    uint8_t failStreak;                 // Consecutive failed scans
+    uint8_t skipScans;                  // Scans left before the next attempt
+} TEMP_SENSOR_HEALTH;
+
+// I2C error counters, read through X2Cscope
+typedef struct
+{
+    uint32_t nak;
+    uint32_t bus;
+    uint32_t retries;
+    uint32_t recoveries;
+    uint32_t stalls;                    // Scans aborted after I2C_STALL_MATCHES
+} I2C_ERROR_COUNTERS;
+
+TEMP_SENSOR_HEALTH tempSensorHealth[TEMP_SENSOR_COUNT];
+I2C_ERROR_COUNTERS i2cErrors;
+
+#if APP_LOG_ENABLE
+// Log records dropped or failed by the backend
+static volatile uint32_t logDropCount = 0;
+#endif
+
+#if APP_LOG_BACKEND == APP_LOG_BACKEND_UART
+// UART transmit queue. main() fills the slot at uartTxHead, the DMA channel
+// handler retires the slot at uartTxTail and starts the next pending one.
+static uint8_t uartTxBuffer[UART_TX_QUEUE_DEPTH][UART_TX_BUFFER_SIZE] = {{0}};
+static uint8_t uartTxLength[UART_TX_QUEUE_DEPTH] = {0};
+static volatile uint8_t uartTxHead = 0;
+static volatile uint8_t uartTxTail = 0;
+#elif APP_LOG_BACKEND == APP_LOG_BACKEND_RING
+// Log byte stream kept in RAM for the host. logRingHead counts every byte
+// ever written; the host copies the bytes between its previous head and the
+// current one and knows it fell behind when that exceeds LOG_RING_SIZE.
+uint8_t logRing[LOG_RING_SIZE];
+volatile uint16_t logRingHead = 0;
+static uint8_t logRecord[UART_TX_BUFFER_SIZE];
+#endif
+
+#if APP_SAMPLE_HISTORY_ENABLE
+// Timestamped sample kept in the history ring
+typedef struct
+{
+    uint32_t timestamp;                 // RTC counter when the sample was taken
+    int16_t temperatureQ8;              // Q8.8 degrees Celsius
+    uint16_t sequence;                  // Free-running sample number
+} TEMP_SAMPLE;
+
+// Sample history for block reads over X2Cscope. The firmware advances
+// sampleHistoryHead after writing an entry; the host advances
+// sampleHistoryTail after reading. Both are free running, the slot is
+// index % SAMPLE_HISTORY_DEPTH. On overflow the oldest entry is dropped.
+TEMP_SAMPLE sampleHistory[SAMPLE_HISTORY_DEPTH];
+volatile uint16_t sampleHistoryHead = 0;
+volatile uint16_t sampleHistoryTail = 0;
+volatile uint16_t sampleHistoryOverruns = 0;
+#endif // APP_SAMPLE_HISTORY_ENABLE
+
+uint8_t TemperatureValueX2C=0;
+// Signed temperature in Q8.8 degrees Celsius (divide by 256)
+int16_t TemperatureQ8X2C=0;
+// Q8.8 temperature of every sensor in tempSensors[], updated per scan
+int16_t TempSensorQ8X2C[TEMP_SENSOR_COUNT] = {0};
+// Primary sensor after the IIR filter, Q8.8 degrees Celsius
+int16_t TemperatureFilteredQ8X2C=0;
+// Time of TemperatureQ8X2C in RTC ticks since start (1/RTC_CLOCK_HZ s)
+uint32_t TemperatureTimestampX2C=0;
+
+// Layout revision of APP_TELEMETRY; bump when fields move or change meaning
+#define APP_TELEMETRY_VERSION                   1U
+
+// APP_TELEMETRY.flags
+#define APP_TELEMETRY_FLAG_BINARY_LOG           0x01U
+#define APP_TELEMETRY_FLAG_REPORT_BY_EXCEPTION  0x02U
+
+// Snapshot of the exported state in one block, so the host fetches it with a
+// single X2Cscope memory read. Fields are naturally aligned and the struct is
+// packed only to pin the layout; new fields are appended and version bumped.
+typedef struct __attribute__((packed))
+{
+    uint8_t version;                    // APP_TELEMETRY_VERSION
+    uint8_t size;                       // sizeof(APP_TELEMETRY)
+    uint8_t sampleRate;                 // TEMP_SAMPLING_RATE
+    uint8_t temperature;                // Whole degrees Celsius
+    int16_t temperatureQ8;              // Q8.8 degrees Celsius
+    int16_t filteredQ8;                 // After the IIR filter, Q8.8
+    uint32_t timestamp;                 // RTC ticks of the sample
+    uint32_t samplePeriod;              // RTC ticks between samples
+    uint32_t sampleCount;               // Samples published since start
+    uint32_t missedReads;               // RTC matches with a scan still running
+    uint32_t i2cNak;
+    uint32_t i2cBus;
+    uint32_t uartDrops;                 // Log messages lost or failed
+    uint32_t reportCount;               // Samples logged
+    uint16_t eventOverflows;
+    uint8_t sensorsValid;               // Sensors that answered, bit per sensor
+    uint8_t flags;                      // APP_TELEMETRY_FLAG_*
+} APP_TELEMETRY;
+
+_Static_assert(sizeof(APP_TELEMETRY) == 44U, "APP_TELEMETRY layout changed, bump APP_TELEMETRY_VERSION");
+
+// Refreshed from main(), the same context that serves X2Cscope reads, so a
+// host read never sees a half-updated record
+APP_TELEMETRY telemetry = { .version = APP_TELEMETRY_VERSION, .size = sizeof(APP_TELEMETRY) };
+
+#if APP_STATS_ENABLE
+// Streaming statistics of one signal (Welford's method, integer only).
+// mean keeps 8 extra fraction bits; variance is the sample variance in
+// signal units squared with 8 fraction bits and saturates at UINT32_MAX.
+typedef struct
+{
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int32_t mean;
+    uint32_t variance;
+    int64_t m2;                         // Sum of squared deviations, 16 fraction bits
+} STATS_CHANNEL;
+
+typedef struct
+{
+    STATS_CHANNEL temperature;          // Primary sensor, Q8.8 degrees Celsius
+    STATS_CHANNEL jitter;               // Sample interval minus the period, RTC ticks
+} APP_STATS;
+
+// Soak test statistics since the last reset, polled through X2Cscope. Each
+// sample costs a constant few hundred cycles, however long the run. Write
+// statsReset = 1 to start over; it takes effect with the next sample.
+APP_STATS stats;
+volatile bool statsReset = true;
+// Time of the previous good sample; cleared when the interval is not a
+// single period (missed sample, period change)
+static uint32_t statsLastTimestamp = 0;
+static bool statsLastValid = false;
+// Set by the RTC handler when a match was skipped or the period switched;
+// each scan takes it over together with the period it was started with
+static volatile bool rtcIntervalIrregular = false;
+static volatile bool i2cScanIrregular = false;
+static volatile uint32_t i2cScanPeriod = PERIOD_500MS;
+#endif // APP_STATS_ENABLE
+
+#if APP_TRIGGER_ENABLE
+// Value the trigger condition watches
+typedef enum
+{
+    TRIGGER_SOURCE_TEMPERATURE = 0,     // TemperatureQ8X2C
+    TRIGGER_SOURCE_FILTERED = 1,        // TemperatureFilteredQ8X2C
+    TRIGGER_SOURCE_I2C_ERRORS = 2,      // NAKs plus bus errors
+} TRIGGER_SOURCE;
+
+// Trigger condition against triggerLevel; prev is the previous capture sample
+typedef enum
+{
+    TRIGGER_MODE_RISING = 0,            // prev < level <= value
+    TRIGGER_MODE_FALLING = 1,           // prev > level >= value
+    TRIGGER_MODE_ABOVE = 2,             // value >= level
+    TRIGGER_MODE_BELOW = 3,             // value <= level
+    TRIGGER_MODE_CHANGE = 4,            // value != prev, level ignored
+} TRIGGER_MODE;
+
+typedef enum
+{
+    TRIGGER_STATE_IDLE = 0,
+    TRIGGER_STATE_PRETRIGGER = 1,       // Filling the pre-trigger samples
+    TRIGGER_STATE_ARMED = 2,            // Waiting for the condition
+    TRIGGER_STATE_POSTTRIGGER = 3,      // Filling the rest of the window
+    TRIGGER_STATE_DONE = 4,             // Window complete, ready for download
+} TRIGGER_STATE;
+
+// One capture sample
+typedef struct
+{
+    uint16_t tick;                      // 1 ms tick counter, wraps
+    int16_t temperatureQ8;
+    int16_t filteredQ8;
+    uint16_t i2cErrors;                 // NAKs plus bus errors, low 16 bits
+} TRIGGER_SAMPLE;
+
+// Set up by the host through X2Cscope, then triggerArm = 1. The window holds
+// TRIGGER_BUFFER_DEPTH samples, one every triggerPrescaler ms, with
+// triggerPreSamples of them before the trigger. Once triggerState reads
+// TRIGGER_STATE_DONE the window starts at triggerBuffer[triggerStart] and
+// wraps around; the engine stays idle until armed again.
+volatile uint8_t triggerSource = TRIGGER_SOURCE_TEMPERATURE;
+volatile uint8_t triggerMode = TRIGGER_MODE_RISING;
+volatile int32_t triggerLevel = 0;
+volatile uint16_t triggerPreSamples = TRIGGER_BUFFER_DEPTH / 4U;
+volatile uint16_t triggerPrescaler = 1;
+volatile bool triggerArm = false;
+volatile uint8_t triggerState = TRIGGER_STATE_IDLE;
+volatile uint16_t triggerStart = 0;
+TRIGGER_SAMPLE triggerBuffer[TRIGGER_BUFFER_DEPTH];
+
+static uint16_t triggerTick = 0;
+static uint16_t triggerWrite = 0;
+static uint16_t triggerRemaining = 0;
+static uint16_t triggerPrescalerCount = 0;
+static int32_t triggerPrevious = 0;
+#endif // APP_TRIGGER_ENABLE
+
+// Written by the host through X2Cscope: reads per sensor and period
+// (1..TEMP_OVERSAMPLE_MAX, averaged) and the filter coefficient in Q15
+// (y += alpha * (x - y); 32768 disables the filter)
+static volatile uint8_t tempOversample = 1;
+static volatile uint16_t tempFilterAlpha = 8192;
+// Filter state with 8 extra fraction bits, primed by the first sample
+static int32_t tempFilterState = 0;
+static bool tempFilterPrimed = false;
+
+#if APP_SETTINGS_ENABLE
+#define APP_SETTINGS_MAGIC                      0x5354U
+// Layout revision of APP_SETTINGS; records of another version are ignored
+#define APP_SETTINGS_VERSION                    1U
+#define SETTINGS_NVM_PAGES                      ((SETTINGS_NVM_ROWS * NVMCTRL_RWWEEPROM_ROWSIZE) / NVMCTRL_RWWEEPROM_PAGESIZE)
+#define SETTINGS_NVM_PAGES_PER_ROW              (NVMCTRL_RWWEEPROM_ROWSIZE / NVMCTRL_RWWEEPROM_PAGESIZE)
+
+// Host configuration as stored in one RWW EEPROM page
+typedef struct
+{
+    uint16_t magic;                     // APP_SETTINGS_MAGIC, erased flash reads 0xFFFF
+    uint8_t version;                    // APP_SETTINGS_VERSION
+    uint8_t size;                       // sizeof(APP_SETTINGS)
+    uint32_t sequence;                  // Incremented on every commit, the highest wins
+    uint32_t samplePeriod;              // tempSamplePeriod
+    uint16_t filterAlpha;               // tempFilterAlpha
+    uint16_t reportDeadbandQ8;
+    uint16_t reportHeartbeat;
+    uint8_t oversample;                 // tempOversample
+    uint8_t telemetryMode;
+    uint8_t reportByException;
+    uint8_t reserved;
+    uint16_t crc;                       // CRC-16/CCITT-FALSE over the bytes before it
+} APP_SETTINGS;
+
+_Static_assert(sizeof(APP_SETTINGS) <= NVMCTRL_RWWEEPROM_PAGESIZE, "APP_SETTINGS does not fit a page");
+
+// settingsCommand, written by the host through X2Cscope
+typedef enum
+{
+    SETTINGS_COMMAND_NONE = 0,
+    SETTINGS_COMMAND_SAVE = 1,          // Store the current configuration
+    SETTINGS_COMMAND_DEFAULTS = 2,      // Go back to the built-in values and store them
+} SETTINGS_COMMAND;
+
+typedef enum
+{
+    SETTINGS_STATUS_DEFAULTS = 0,       // Booted without a valid record
+    SETTINGS_STATUS_LOADED = 1,         // Booted from the stored record
+    SETTINGS_STATUS_BUSY = 2,           // Commit in progress
+    SETTINGS_STATUS_SAVED = 3,
+    SETTINGS_STATUS_ERROR = 4,          // Read back did not match, retry to use the next page
+} SETTINGS_STATUS;
+
+// Steps of a commit; the NVM works in the background and main() polls it
+typedef enum
+{
+    SETTINGS_STEP_IDLE = 0,
+    SETTINGS_STEP_ERASE = 1,
+    SETTINGS_STEP_WRITE = 2,
+    SETTINGS_STEP_VERIFY = 3,
+} SETTINGS_STEP;
+
+// The host sets the values above as usual, then writes settingsCommand and
+// polls settingsStatus. settingsSequence is the sequence of the record in use.
+volatile uint8_t settingsCommand = SETTINGS_COMMAND_NONE;
+volatile uint8_t settingsStatus = SETTINGS_STATUS_DEFAULTS;
+volatile uint32_t settingsSequence = 0;
+
+static APP_SETTINGS settingsDefaults;
+static uint32_t settingsPageBuffer[NVMCTRL_RWWEEPROM_PAGESIZE / sizeof(uint32_t)];
+static uint8_t settingsPage = 0;        // Page of the next commit
+static SETTINGS_STEP settingsStep = SETTINGS_STEP_IDLE;
+#endif // APP_SETTINGS_ENABLE
+
+// Post an event from interrupt context. The handlers can preempt each other,
+// and the Cortex-M0+ has no exclusive load/store, so the head slot is claimed
+// with interrupts masked for a few instructions.
+static void appEventPost(APP_EVENT event)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if ((uint8_t)(appEventHead - appEventTail) < APP_EVENT_QUEUE_DEPTH)
+    {
+        appEventQueue[appEventHead % APP_EVENT_QUEUE_DEPTH] = (uint8_t)event;
+        appEventHead++;
+    }
+    else
+    {
+        appEventOverflows++;
+    }
+    __set_PRIMASK(primask);
+}
+
+// Take the oldest pending event. main() is the only consumer, so this side
+// needs no locking.
+static bool appEventGet(APP_EVENT* event)
+{
+    uint8_t tail = appEventTail;
+
+    if (tail == appEventHead)
+    {
+        return false;
+    }
+    *event = (APP_EVENT)appEventQueue[tail % APP_EVENT_QUEUE_DEPTH];
+    appEventTail = tail + 1U;
+    return true;
+}
+
+// Start SysTick as a free running cycle counter for the profiler and short
+// delays. The Cortex-M0+ has no DWT cycle counter, SysTick without its
+// interrupt is the closest equivalent.
+static void cycleCounterInitialize(void)
+{
+    SysTick->LOAD = PROFILE_COUNTER_MASK;
+    SysTick->VAL = 0U;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
+#if APP_PROFILING_ENABLE
+// Counter value at the start of a section
+static inline uint32_t profileStart(void)
+{
+    return SysTick->VAL;
+}
+
+// Account the cycles since start to a section. Each section is updated from
+// one context only, or from interrupts of one priority that cannot preempt
+// each other, so no locking is required.
+static void profileStop(PROFILE_SECTION_ID id, uint32_t start)
+{
+    // SysTick counts down; valid for sections shorter than 2^24 cycles
+    uint32_t cycles = (start - SysTick->VAL) & PROFILE_COUNTER_MASK;
+    PROFILE_SECTION* section = &profile[id];
+
+    if ((section->count == 0U) || (cycles < section->min))
+    {
+        section->min = cycles;
+    }
+    if (cycles > section->max)
+    {
+        section->max = cycles;
+    }
+    if (section->count == 0U)
+    {
+        section->avg = cycles;
+    }
+    else
+    {
+        section->avg = (uint32_t)((int32_t)section->avg +
+                ((int32_t)(cycles - section->avg) >> PROFILE_AVERAGE_SHIFT));
+    }
+    section->count++;
+}
+
+// Clear all sections on request from the host
+static void profileUpdate(void)
+{
+    if (profileReset == true)
+    {
+        __disable_irq();
+        memset(profile, 0, sizeof(profile));
+        profileReset = false;
+        __enable_irq();
+    }
+}
+#else
+#define profileStart()                          0U
+#define profileStop(id, start)                  ((void)(start))
+#define profileUpdate()
+#endif // APP_PROFILING_ENABLE
+
+#if APP_SAMPLE_HISTORY_ENABLE
+// Append one sample to the history ring, dropping the oldest when full.
+// Called from the main loop, which is also where X2Cscope writes
+// sampleHistoryTail, so no locking is required.
+static void sampleHistoryPush(uint32_t timestamp, int16_t tempQ8)
+{
+    TEMP_SAMPLE* entry;
+
+    if ((uint16_t)(sampleHistoryHead - sampleHistoryTail) >= SAMPLE_HISTORY_DEPTH)
+    {
+        sampleHistoryTail = sampleHistoryHead - SAMPLE_HISTORY_DEPTH + 1U;
+        sampleHistoryOverruns++;
+    }
+    entry = &sampleHistory[sampleHistoryHead % SAMPLE_HISTORY_DEPTH];
+    entry->timestamp = timestamp;
+    entry->temperatureQ8 = tempQ8;
+    entry->sequence = sampleHistoryHead;
+    sampleHistoryHead++;
+}
+#endif // APP_SAMPLE_HISTORY_ENABLE
+
+#if APP_LOG_ENABLE || APP_SETTINGS_ENABLE
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over a frame body or a
+// settings record
+static uint16_t telemetryCrc16(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFFU;
+
+    while (length-- > 0U)
+    {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t bit = 0; bit < 8U; bit++)
+        {
+            crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+#endif
+
+#if APP_LOG_ENABLE
+// Fixed UART message with its length known at compile time
+typedef struct
+{
+    const char* text;
+    uint8_t length;
+} UART_MESSAGE;
+
+#define UART_MESSAGE_INIT(str)                  { (str), (uint8_t)(sizeof(str) - 1U) }
+
+// Constant parts of the "Temperature = %02d C t=%u ms\r\n" line
+static const char tempMessagePrefix[] = "Temperature = ";
+static const char tempMessageTime[] = " C t=";
+static const char tempMessageSuffix[] = " ms\r\n";
+
+static const UART_MESSAGE startMessage = UART_MESSAGE_INIT("Start Of Program \r\n");
+
+// Constant parts of the "Sampling Temperature every %u ms \r\n" line
+static const char periodMessagePrefix[] = "Sampling Temperature every ";
+static const char periodMessageSuffix[] = " ms \r\n";
+
+// Copy a constant message into the transmit buffer and return its length
+static size_t uartFormatMessage(uint8_t* buffer, const UART_MESSAGE* message)
+{
+    memcpy(buffer, message->text, message->length);
+    return message->length;
+}
+
+// Write an unsigned decimal with at least minDigits digits and return the
+// position after the last digit
+static uint8_t* uartFormatDecimal(uint8_t* p, uint32_t value, uint8_t minDigits)
+{
+    uint8_t digits[10];
+    uint8_t count = 0;
+
+    do
+    {
+        digits[count++] = (uint8_t)('0' + (value % 10U));
+        value /= 10U;
+    } while ((value != 0U) || (count < minDigits));
+
+    while (count > 0U)
+    {
+        *p++ = digits[--count];
+    }
+    return p;
+}
+
+// Format "Temperature = %02d C t=%u ms\r\n" into the transmit buffer without
+// sprintf and return the number of bytes written. The time is the RTC sample
+// time in milliseconds and wraps after about 49 days.
+static size_t uartFormatTemperature(uint8_t* buffer, uint8_t value, uint32_t timestamp)
+{
+    uint8_t* p = buffer;
+
+    memcpy(p, tempMessagePrefix, sizeof(tempMessagePrefix) - 1U);
+    p += sizeof(tempMessagePrefix) - 1U;
+    p = uartFormatDecimal(p, value, 2U);
+    memcpy(p, tempMessageTime, sizeof(tempMessageTime) - 1U);
+    p += sizeof(tempMessageTime) - 1U;
+    p = uartFormatDecimal(p, (uint32_t)(((uint64_t)timestamp * 1000U) / RTC_CLOCK_HZ), 1U);
+    memcpy(p, tempMessageSuffix, sizeof(tempMessageSuffix) - 1U);
+    p += sizeof(tempMessageSuffix) - 1U;
+
+    return (size_t)(p - buffer);
+}
+
+// Format "Sampling Temperature every %u ms \r\n" for a host-selected period
+static size_t uartFormatPeriod(uint8_t* buffer, uint32_t period)
+{
+    uint8_t* p = buffer;
+
+    memcpy(p, periodMessagePrefix, sizeof(periodMessagePrefix) - 1U);
+    p += sizeof(periodMessagePrefix) - 1U;
+    p = uartFormatDecimal(p, (period * 1000U + (RTC_CLOCK_HZ / 2U)) / RTC_CLOCK_HZ, 1U);
+    memcpy(p, periodMessageSuffix, sizeof(periodMessageSuffix) - 1U);
+    p += sizeof(periodMessageSuffix) - 1U;
+
+    return (size_t)(p - buffer);
+}
+
+// Encode one binary telemetry frame into the transmit buffer and return its length
+static size_t uartFormatFrame(uint8_t* buffer, uint32_t timestamp, const uint8_t* rawTempValue)
+{
+    uint16_t crc;
+
+    buffer[0] = TELEMETRY_FRAME_SYNC;
+    buffer[1] = telemetrySequence++;
+    buffer[2] = (uint8_t)timestamp;
+    buffer[3] = (uint8_t)(timestamp >> 8);
+    buffer[4] = (uint8_t)(timestamp >> 16);
+    buffer[5] = (uint8_t)(timestamp >> 24);
+    // Raw sensor word, little endian like the other fields (the bus
+    // delivers the MSB first, in rawTempValue[0])
+    buffer[6] = rawTempValue[1];
+    buffer[7] = rawTempValue[0];
+    buffer[8] = (uint8_t)tempSampleRate;
+    crc = telemetryCrc16(&buffer[1], TELEMETRY_FRAME_SIZE - 3U);
+    buffer[9] = (uint8_t)crc;
+    buffer[10] = (uint8_t)(crc >> 8);
+
+    return TELEMETRY_FRAME_SIZE;
+}
+
+#if APP_LOG_BACKEND == APP_LOG_BACKEND_UART
+// Start the DMA transfer of the slot at the tail of the transmit queue
+static void uartTxStart(void)
+{
+    uint8_t slot = uartTxTail % UART_TX_QUEUE_DEPTH;
+
+    isUSARTTxComplete = false;
+    DMAC_ChannelTransfer(LOG_DMA_CHANNEL, uartTxBuffer[slot], \
+            (const void *)&(LOG_USART_REGS->USART_INT.SERCOM_DATA), \
+            uartTxLength[slot]);
+}
+
+// Return the next free transmit slot, or NULL when all slots are in use
+static uint8_t* logReserve(void)
+{
+    if ((uint8_t)(uartTxHead - uartTxTail) >= UART_TX_QUEUE_DEPTH)
+    {
+        logDropCount++;
+        return NULL;
+    }
+    return uartTxBuffer[uartTxHead % UART_TX_QUEUE_DEPTH];
+}
+
+// Queue the reserved slot for transmission and start DMA if it is idle
+static void logCommit(size_t length)
+{
+    uartTxLength[uartTxHead % UART_TX_QUEUE_DEPTH] = (uint8_t)length;
+
+    __disable_irq();
+    uartTxHead++;
+    if (isUSARTTxComplete == true)
+    {
+        uartTxStart();
+    }
+    __enable_irq();
+}
+#elif APP_LOG_BACKEND == APP_LOG_BACKEND_RING
+// The record is formatted in place and copied into the ring on commit, so
+// the ring backend never drops; old bytes are overwritten instead
+static uint8_t* logReserve(void)
+{
+    return logRecord;
+}
+
+static void logCommit(size_t length)
+{
+    uint16_t head = logRingHead;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        logRing[(uint16_t)(head + i) % LOG_RING_SIZE] = logRecord[i];
+    }
+    logRingHead = (uint16_t)(head + length);
+}
+#endif
+#endif // APP_LOG_ENABLE
+
+// Button-selectable sampling rates, indexed by TEMP_SAMPLING_RATE
+typedef struct
+{
+    uint32_t period;                    // RTC compare value
+#if APP_LOG_ENABLE
+    UART_MESSAGE message;
+#endif
+} TEMP_SAMPLING_RATE_CONFIG;
+
+// Log text of a table entry, left out when the UART log is not built
+#if APP_LOG_ENABLE
+#define TEMP_SAMPLING_RATE_MESSAGE(str)         UART_MESSAGE_INIT(str)
+#else
+#define TEMP_SAMPLING_RATE_MESSAGE(str)
+#endif
+
+static const TEMP_SAMPLING_RATE_CONFIG samplingRates[TEMP_SAMPLING_RATE_COUNT] =
+{
+    [TEMP_SAMPLING_RATE_500MS] = { PERIOD_500MS, TEMP_SAMPLING_RATE_MESSAGE("Sampling Temperature every 500 ms \r\n") },
+    [TEMP_SAMPLING_RATE_1S]    = { PERIOD_1S,    TEMP_SAMPLING_RATE_MESSAGE("Sampling Temperature every 1 second \r\n") },
+    [TEMP_SAMPLING_RATE_2S]    = { PERIOD_2S,    TEMP_SAMPLING_RATE_MESSAGE("Sampling Temperature every 2 seconds \r\n") },
+    [TEMP_SAMPLING_RATE_4S]    = { PERIOD_4S,    TEMP_SAMPLING_RATE_MESSAGE("Sampling Temperature every 4 seconds \r\n") },
+};
+
+// Function to convert raw temperature value to signed Q8.8 Degree Celsius
+static int16_t getTemperatureQ8(const uint8_t* rawTempValue)
+{
+    // The sensor sends a left-aligned two's complement value with the integer
+    // degrees in the MSB, so the masked word already is Q8.8 (-55 C .. +125 C)
+    return (int16_t)((((uint16_t)rawTempValue[0] << 8) | rawTempValue[1]) & TEMP_SENSOR_DATA_MASK);
+}
+
+// Function to convert Q8.8 temperature to whole Degree Celsius for the log
+static uint8_t getTemperature(int16_t tempQ8)
+{
+    // Truncate toward zero; for demonstration purpose the log assumes the
+    // temperature is positive
+    // Fahrenheit in Q8.8 would be ((int32_t)tempQ8 * 9 / 5) + (32 << 8)
+    return (uint8_t)((tempQ8 >> 7) / 2); // Celsius
+}
+
+// Current time in RTC ticks since start. A match that is flagged but not yet
+// handled means the counter has already cleared, so the epoch is advanced
+// here as the RTC handler will do. Assumes the RTC interrupt cannot preempt
+// its callers between clearing the flag and updating the epoch.
+static uint32_t rtcTimestampGet(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t epoch;
+    uint32_t count;
+
+    __disable_irq();
+    epoch = rtcEpoch;
+    count = RTC_Timer32CounterGet();
+    if ((RTC_REGS->MODE0.RTC_INTFLAG & RTC_MODE0_INTFLAG_CMP0_Msk) != 0U)
+    {
+        epoch += tempSamplePeriodApplied + 1U;
+        count = RTC_Timer32CounterGet();
+    }
+    __set_PRIMASK(primask);
+    return epoch + count;
+}
+
+// Interrupt handler for external interrupt controller
+static void EIC_User_Handler(uintptr_t context)
+{
+    appEventPost(APP_EVENT_RATE_CHANGE);
+}
+
+// Record a sensor that failed all retries and back off exponentially
+static void i2cSensorFailed(uint8_t job)
+{
+    TEMP_SENSOR_HEALTH* health = &tempSensorHealth[job];
+
+    health->failures++;
+    if (health->failStreak < (I2C_BACKOFF_MAX_SHIFT + 1U))
+    {
+        health->failStreak++;
+    }
+    health->skipScans = (uint8_t)((1U << (health->failStreak - 1U)) - 1U);
+}
+
+// Average the oversampled reads of the finished scan per sensor
+// and queue the result for main()
+static void i2cScanFinish(void)
+{
+    uint8_t head = i2cScanResultHead;
+    I2C_SCAN_RESULT* result;
+
+    if ((uint8_t)(head - i2cScanResultTail) >= I2C_SCAN_RESULT_DEPTH)
+    {
+        i2cScanOverruns++;
+        return;
+    }
+    result = &i2cScanResults[head % I2C_SCAN_RESULT_DEPTH];
+    result->valid = 0;
+    for (uint8_t job = 0; job < TEMP_SENSOR_COUNT; job++)
+    {
+        result->tempQ8[job] = 0;
+        if (i2cSampleCount[job] > 0U)
+        {
+            result->tempQ8[job] = (int16_t)(i2cSampleSum[job] / i2cSampleCount[job]);
+            result->valid |= (1UL << job);
+        }
+    }
+    result->timestamp = i2cSampleTime[0];
+    result->raw[0] = i2cRdData[0][0];
+    result->raw[1] = i2cRdData[0][1];
+#if APP_STATS_ENABLE
+    result->irregular = i2cScanIrregular;
+    result->period = i2cScanPeriod;
+#endif
+    i2cScanResultHead = head + 1U;
+}
+
+// Take the oldest completed scan. main() is the only consumer.
+static bool i2cScanResultGet(I2C_SCAN_RESULT* result)
+{
+    uint8_t tail = i2cScanResultTail;
+
+    if (tail == i2cScanResultHead)
+    {
+        return false;
+    }
+    *result = i2cScanResults[tail % I2C_SCAN_RESULT_DEPTH];
+    i2cScanResultTail = tail + 1U;
+    return true;
+}
+
+#if APP_I2C_DMA_ENABLE
+// Read the two data bytes of a sensor whose pointer is already set. With
+// ADDR.LENEN SERCOM2 NACKs the last byte and sends STOP by itself, DMA moves
+// the bytes, and the DMA completion is the only interrupt of the read.
+static bool i2cDmaRead(uint16_t address, uint8_t* data)
+{
+    sercom_registers_t* i2c = SERCOM2_REGS;
+
+    if (SERCOM2_I2C_IsBusy() == true)
+    {
+        return false;
+    }
+    // Keep the PLIB interrupt out of it; its next transfer enables it again
+    i2c->I2CM.SERCOM_INTENCLR = SERCOM_I2CM_INTENCLR_Msk;
+    i2c->I2CM.SERCOM_CTRLB = (i2c->I2CM.SERCOM_CTRLB & ~SERCOM_I2CM_CTRLB_ACKACT_Msk) |
+            SERCOM_I2CM_CTRLB_SMEN_Msk;
+    while (i2c->I2CM.SERCOM_SYNCBUSY != 0U)
+    {
+    }
+    if (DMAC_ChannelTransfer(I2C_DMA_CHANNEL, (const void *)&(i2c->I2CM.SERCOM_DATA), \
+            data, 2U) == false)
+    {
+        return false;
+    }
+    i2cDmaTicks = I2C_DMA_TIMEOUT_TICKS;
+    i2c->I2CM.SERCOM_ADDR = SERCOM_I2CM_ADDR_ADDR(((uint32_t)address << 1) | 1U) |
+            SERCOM_I2CM_ADDR_LENEN_Msk | SERCOM_I2CM_ADDR_LEN(2U);
+    while (i2c->I2CM.SERCOM_SYNCBUSY != 0U)
+    {
+    }
+    return true;
+}
+#endif // APP_I2C_DMA_ENABLE
+
+// Start the read of sensor i2cJob, skipping sensors in back-off and those
+// whose transfer cannot be queued. Each round reads every sensor once; after
+// the last round the scan is handed to main().
+static void i2cScanNext(void)
+{
+    while (true)
+    {
+        if (i2cJob >= TEMP_SENSOR_COUNT)
+        {
+            if ((i2cRound + 1U) >= i2cRounds)
+            {
+                break;
+            }
+            i2cRound++;
+            i2cJob = 0;
+        }
+
+        TEMP_SENSOR_CONFIG* sensor = &tempSensors[i2cJob];
+        TEMP_SENSOR_HEALTH* health = &tempSensorHealth[i2cJob];
+
+        if (health->skipScans > 0U)
+        {
+            // Count the back-off once per scan
+            if (i2cRound == 0U)
+            {
+                health->skipScans--;
+            }
+        }
+#if APP_I2C_DMA_ENABLE
+        else if ((i2cPointerValid[i2cJob] == true) &&
+                 (i2cDmaRead(sensor->address, i2cRdData[i2cJob]) == true))
+        {
+            return;
+        }
+#endif
+        else if (SERCOM2_I2C_WriteRead(sensor->address, &sensor->reg, 1, i2cRdData[i2cJob], 2) == true)
+        {
+            return;
+        }
+        else
+        {
+            i2cSensorFailed(i2cJob);
+        }
+        i2cJob++;
+        i2cAttempt = 0;
+    }
+    i2cScanFinish();
+    i2cScanActive = false;
+    appEventPost(APP_EVENT_TEMPERATURE_READ);
+}
+
+// RTC event handler
+static void rtcEventHandler (RTC_TIMER32_INT_MASK intCause, uintptr_t context)
+{
+    if (intCause & RTC_MODE0_INTENSET_CMP0_Msk)
+    {
+        // The counter cleared one tick after matching the compare value
+        rtcEpoch += tempSamplePeriodApplied + 1U;
+        // Switch the period now that the counter has just cleared; written
+        // at any other time, a compare value below the current count would
+        // only match after the 32-bit counter wraps
+        if (tempSamplePeriodPending != tempSamplePeriodApplied)
+        {
+            tempSamplePeriodApplied = tempSamplePeriodPending;
+            RTC_Timer32CompareSet(tempSamplePeriodApplied);
+#if APP_STATS_ENABLE
+            rtcIntervalIrregular = true;
+#endif
+        }
+
+        // Start the sensor scan right here so the sample instant follows the
+        // RTC match rather than main loop latency; main() only sees the result
+        if (i2cScanActive == true)
+        {
+            i2cMissedReads++;
+#if APP_STATS_ENABLE
+            rtcIntervalIrregular = true;
+#endif
+            // A transfer that never calls back would keep the scan active
+            // for good; after a few periods recover the bus like on a bus error
+            if ((i2cRecoveryPending == false) && (++i2cStallMatches >= I2C_STALL_MATCHES))
+            {
+                i2cErrors.stalls++;
+                if (i2cJob < TEMP_SENSOR_COUNT)
+                {
+                    i2cSensorFailed(i2cJob);
+                }
+                i2cRecoveryPending = true;
+                appEventPost(APP_EVENT_I2C_BUS_ERROR);
+            }
+            return;
+        }
+        i2cStallMatches = 0;
+        i2cScanActive = true;
+#if APP_STATS_ENABLE
+        i2cScanIrregular = rtcIntervalIrregular;
+        i2cScanPeriod = tempSamplePeriodApplied;
+        rtcIntervalIrregular = false;
+#endif
+        memset(i2cSampleSum, 0, sizeof(i2cSampleSum));
+        memset(i2cSampleCount, 0, sizeof(i2cSampleCount));
+        i2cRounds = ((tempOversample == 0U) || (tempOversample > TEMP_OVERSAMPLE_MAX)) ?
+                1U : tempOversample;
+        i2cRound = 0;
+        i2cJob = 0;
+        i2cScanNext();
+    }
+}
+
+// I2C event handler: store the result and chain the next sensor without
+// going through the main loop
+static void i2cEventHandler(uintptr_t contextHandle)
+{
+    uint32_t start = profileStart();
+    uint8_t job = i2cJob;
+#if APP_I2C_DMA_ENABLE
+    SERCOM_I2C_ERROR error = (contextHandle == I2C_CONTEXT_DMA) ?
+            i2cDmaError : SERCOM2_I2C_ErrorGet();
+#else
+    SERCOM_I2C_ERROR error = SERCOM2_I2C_ErrorGet();
+#endif
+
+    if (i2cRecoveryPending == true)
+    {
+        // The scan was given up, main() recovers the bus and finishes it
+        profileStop(PROFILE_SECTION_I2C_HANDLER, start);
+        return;
+    }
+#if APP_I2C_DMA_ENABLE
+    // Any failure may have left the pointer elsewhere, rewrite it next time
+    i2cPointerValid[job] = (error == SERCOM_I2C_ERROR_NONE);
+#endif
+
+    if (error == SERCOM_I2C_ERROR_NONE)
+    {
+        // Stamp the sample when its data arrives rather than when main()
+        // gets to it; with oversampling the first read of the scan counts
+        if (i2cSampleCount[job] == 0U)
+        {
+            i2cSampleTime[job] = rtcTimestampGet();
+        }
+        i2cSampleSum[job] += getTemperatureQ8(i2cRdData[job]);
+        i2cSampleCount[job]++;
+        tempSensorHealth[job].failStreak = 0;
+    }
+    else if (error == SERCOM_I2C_ERROR_BUS)
+    {
+        // The bus itself is stuck; main() clocks it free and finishes the
+        // scan, i2cScanActive stays set until then
+        i2cErrors.bus++;
+        i2cSensorFailed(job);
+        i2cRecoveryPending = true;
+        appEventPost(APP_EVENT_I2C_BUS_ERROR);
+        profileStop(PROFILE_SECTION_I2C_HANDLER, start);
+        return;
+    }
+    else
+    {
+        i2cErrors.nak++;
+        if (i2cAttempt < I2C_RETRY_LIMIT)
+        {
+            // One bounded retry of the same sensor
+            i2cAttempt++;
+            i2cErrors.retries++;
+            i2cScanNext();
+            profileStop(PROFILE_SECTION_I2C_HANDLER, start);
+            return;
+        }
+        i2cSensorFailed(job);
+    }
+    i2cJob = job + 1U;
+    i2cAttempt = 0;
+    i2cScanNext();
+    profileStop(PROFILE_SECTION_I2C_HANDLER, start);
+}
+
+#if APP_I2C_DMA_ENABLE
+// Take ownership of the end of the DMA read. The completion and the timeout
+// run in different interrupts and race for it.
+static bool i2cDmaClaim(bool timeoutTick)
+{
+    uint32_t primask = __get_PRIMASK();
+    bool claimed = false;
+
+    __disable_irq();
+    if ((timeoutTick == false) || (i2cDmaTicks == 1U))
+    {
+        claimed = (i2cDmaTicks > 0U);
+        i2cDmaTicks = 0;
+    }
+    else if (i2cDmaTicks > 1U)
+    {
+        i2cDmaTicks--;
+    }
+    __set_PRIMASK(primask);
+    return claimed;
+}
+
+// I2C DMA channel handler: the sensor read is complete
+static void i2cDmaChannelHandler(DMAC_TRANSFER_EVENT event, uintptr_t contextHandle)
+{
+    uint16_t status = SERCOM2_REGS->I2CM.SERCOM_STATUS;
+
+    if (i2cDmaClaim(false) == false)
+    {
+        return;
+    }
+    i2cDmaError = ((event == DMAC_TRANSFER_EVENT_COMPLETE) &&
+            ((status & (SERCOM_I2CM_STATUS_BUSERR_Msk | SERCOM_I2CM_STATUS_ARBLOST_Msk)) == 0U)) ?
+            SERCOM_I2C_ERROR_NONE : SERCOM_I2C_ERROR_BUS;
+    i2cEventHandler(I2C_CONTEXT_DMA);
+}
+
+// Called every 1 ms tick: abort a DMA read that did not complete in time.
+// A NACKed address leaves the master holding the bus, so release it with a
+// STOP; a bus error goes through the bus recovery like the PLIB path.
+static void i2cDmaTimeoutUpdate(void)
+{
+    sercom_registers_t* i2c = SERCOM2_REGS;
+
+    if (i2cDmaClaim(true) == false)
+    {
+        return;
+    }
+    DMAC_ChannelDisable(I2C_DMA_CHANNEL);
+    if ((i2c->I2CM.SERCOM_STATUS & (SERCOM_I2CM_STATUS_BUSERR_Msk | SERCOM_I2CM_STATUS_ARBLOST_Msk)) != 0U)
+    {
+        i2cDmaError = SERCOM_I2C_ERROR_BUS;
+    }
+    else
+    {
+        i2cDmaError = SERCOM_I2C_ERROR_NAK;
+        i2c->I2CM.SERCOM_CTRLB |= SERCOM_I2CM_CTRLB_CMD(3U);
+        while (i2c->I2CM.SERCOM_SYNCBUSY != 0U)
+        {
+        }
+    }
+    i2c->I2CM.SERCOM_INTFLAG = SERCOM_I2CM_INTFLAG_Msk;
+    i2cEventHandler(I2C_CONTEXT_DMA);
+}
+#endif // APP_I2C_DMA_ENABLE
+
+#if APP_LOG_BACKEND == APP_LOG_BACKEND_UART
+// USART DMA channel handler
+static void usartDmaChannelHandler(DMAC_TRANSFER_EVENT event, uintptr_t contextHandle)
+{
+    if (event != DMAC_TRANSFER_EVENT_COMPLETE)
+    {
+        appEventPost(APP_EVENT_UART_TX_ERROR);
+    }
+    // Retire the finished slot; a failed message is not retried
+    uartTxTail++;
+    // Chain the next queued message, or mark the channel idle
+    if (uartTxTail != uartTxHead)
+    {
+        uartTxStart();
+    }
+    else
+    {
+        isUSARTTxComplete = true;
+    }
+}
+#endif
+
+#if APP_TRIGGER_ENABLE
+// Current value of the trigger source
+static int32_t triggerSourceValue(const TRIGGER_SAMPLE* sample)
+{
+    switch ((TRIGGER_SOURCE)triggerSource)
+    {
+        case TRIGGER_SOURCE_FILTERED:
+            return sample->filteredQ8;
+        case TRIGGER_SOURCE_I2C_ERRORS:
+            return sample->i2cErrors;
+        case TRIGGER_SOURCE_TEMPERATURE:
+        default:
+            return sample->temperatureQ8;
+    }
+}
+
+static bool triggerConditionMet(int32_t value)
+{
+    int32_t level = triggerLevel;
+
+    switch ((TRIGGER_MODE)triggerMode)
+    {
+        case TRIGGER_MODE_RISING:
+            return (triggerPrevious < level) && (value >= level);
+        case TRIGGER_MODE_FALLING:
+            return (triggerPrevious > level) && (value <= level);
+        case TRIGGER_MODE_ABOVE:
+            return value >= level;
+        case TRIGGER_MODE_BELOW:
+            return value <= level;
+        case TRIGGER_MODE_CHANGE:
+            return value != triggerPrevious;
+        default:
+            return false;
+    }
+}
+
+// Record one capture sample and run the trigger state machine. Called on
+// every 1 ms tick ahead of the X2Cscope decimation, so the condition is
+// checked on the device without any host round-trip.
+static void triggerUpdate(void)
+{
+    TRIGGER_SAMPLE* sample;
+    int32_t value;
+
+    triggerTick++;
+    if (triggerArm == true)
+    {
+        triggerArm = false;
+        // At least one pre-trigger sample, so an edge always has a previous value
+        if (triggerPreSamples == 0U)
+        {
+            triggerPreSamples = 1U;
+        }
+        else if (triggerPreSamples >= TRIGGER_BUFFER_DEPTH)
+        {
+            triggerPreSamples = TRIGGER_BUFFER_DEPTH - 1U;
+        }
+        triggerRemaining = triggerPreSamples;
+        triggerPrescalerCount = 0;
+        triggerState = TRIGGER_STATE_PRETRIGGER;
+    }
+    if ((triggerState == TRIGGER_STATE_IDLE) || (triggerState == TRIGGER_STATE_DONE))
+    {
+        return;
+    }
+    if (++triggerPrescalerCount < triggerPrescaler)
+    {
+        return;
+    }
+    triggerPrescalerCount = 0;
+
+    sample = &triggerBuffer[triggerWrite % TRIGGER_BUFFER_DEPTH];
+    sample->tick = triggerTick;
+    sample->temperatureQ8 = TemperatureQ8X2C;
+    sample->filteredQ8 = TemperatureFilteredQ8X2C;
+    sample->i2cErrors = (uint16_t)(i2cErrors.nak + i2cErrors.bus);
+    value = triggerSourceValue(sample);
+
+    switch ((TRIGGER_STATE)triggerState)
+    {
+        case TRIGGER_STATE_PRETRIGGER:
+            // Collect the pre-trigger history before looking for the condition
+            if (--triggerRemaining == 0U)
+            {
+                triggerState = TRIGGER_STATE_ARMED;
+            }
+            break;
+        case TRIGGER_STATE_ARMED:
+            if (triggerConditionMet(value) == true)
+            {
+                triggerStart = (uint16_t)(triggerWrite - triggerPreSamples) % TRIGGER_BUFFER_DEPTH;
+                triggerRemaining = TRIGGER_BUFFER_DEPTH - triggerPreSamples - 1U;
+                triggerState = (triggerRemaining > 0U) ? TRIGGER_STATE_POSTTRIGGER : TRIGGER_STATE_DONE;
+            }
+            break;
+        case TRIGGER_STATE_POSTTRIGGER:
+            if (--triggerRemaining == 0U)
+            {
+                triggerState = TRIGGER_STATE_DONE;
+            }
+            break;
+        default:
+            break;
+    }
+    triggerPrevious = value;
+    triggerWrite++;
+}
+#endif // APP_TRIGGER_ENABLE
 
-// Enumeration for temperature sampling rates
-typedef enum
+// 1ms callback for the X2C update
+static void TC0_Callback_InterruptHandler(TC_TIMER_STATUS status, uintptr_t context)
 {
-    TEMP_SAMPLING_RATE_500MS = 0,
-    TEMP_SAMPLING_RATE_1S = 1,
-    TEMP_SAMPLING_RATE_2S = 2,
-    TEMP_SAMPLING_RATE_4S = 3,
-} TEMP_SAMPLING_RATE;
+        uint32_t start;
+        bool update;
 
-// Initialize the temperature sampling rate to 500ms
-static TEMP_SAMPLING_RATE tempSampleRate = TEMP_SAMPLING_RATE_500MS;
+#if APP_I2C_DMA_ENABLE
+        // Outside the X2C_UPDATE section: a timed out read completes here and
+        // is accounted to PROFILE_SECTION_I2C_HANDLER
+        i2cDmaTimeoutUpdate();
+#endif
+        start = profileStart();
+#if APP_LOW_POWER_ENABLE
+        if (x2cscopeAwakeTicks > 0U)
+        {
+            x2cscopeAwakeTicks--;
+        }
+#endif
+#if APP_TRIGGER_ENABLE
+        triggerUpdate();
+#endif
+        if (x2cscopeUpdateMode == X2CSCOPE_UPDATE_ON_CHANGE)
+        {
+            update = x2cscopeSampleRequest;
+            x2cscopeSampleRequest = false;
+        }
+        else
+        {
+            update = (++x2cscopePrescalerCount >= x2cscopePrescaler);
+        }
+        if (update == false)
+        {
+            return;
+        }
+        x2cscopePrescalerCount = 0;
+        // Keep this fast; just push samples to the X2Cscope buffer
+        X2Cscope_Update();
+        profileStop(PROFILE_SECTION_X2C_UPDATE, start);
+}
 
-// Define volatile flags for various events
-static volatile bool isRTCTimerExpired = false;
-static volatile bool changeTempSamplingRate = false;
-static volatile bool isUSARTTxComplete = true;
-static volatile bool isTemperatureRead = false;
+// Busy wait for a number of CPU cycles on the free running SysTick counter
+static void delayCycles(uint32_t cycles)
+{
+    uint32_t start = SysTick->VAL;
 
-// Define variables for temperature value and I2C data
-static uint8_t temperatureVal;
-static uint8_t i2cWrData = TEMP_SENSOR_REG_ADDR;
-static uint8_t i2cRdData[2] = {0};
-static uint8_t uartTxBuffer[100] = {0};
+    while (((start - SysTick->VAL) & PROFILE_COUNTER_MASK) < cycles)
+    {
+        ;
+    }
+}
 
-uint8_t TemperatureValueX2C=0;
+// Drive an I2C line low, or release it to the pull-up
+static void i2cLineLow(PORT_PIN pin)
+{
+    PORT_PinClear(pin);
+    PORT_PinOutputEnable(pin);
+}
 
-// Function to convert raw temperature value to readable format (Degree Celsius)
-static uint8_t getTemperature(uint8_t* rawTempValue)
+static void i2cLineRelease(PORT_PIN pin)
 {
-    int16_t temp;
-    // Convert the temperature value read from sensor to readable format (Degree Celsius)
-    // For demonstration purpose, temperature value is assumed to be positive.
-    // The maximum positive temperature measured by sensor is +125 C
-    temp = (rawTempValue[0] << 8) | rawTempValue[1];
-    temp = (temp >> 7) * 0.5; // Celsius
-    // temp = (temp * 9/5) + 32; // Fahrenheit
-    return (uint8_t)temp;
+    PORT_PinInputEnable(pin);
 }
 
-// Interrupt handler for external interrupt controller
-static void EIC_User_Handler(uintptr_t context)
+// Free a bus held by a slave stuck mid-byte: take the pins as GPIO, clock
+// SCL until the slave releases SDA (at most 9 pulses), send a STOP and
+// reinitialize SERCOM2. Takes about 100 us, run from the main loop.
+static void i2cBusRecover(void)
+{
+    PORT_PinGPIOConfig(I2C_SDA_PIN);
+    PORT_PinGPIOConfig(I2C_SCL_PIN);
+    i2cLineRelease(I2C_SDA_PIN);
+    i2cLineRelease(I2C_SCL_PIN);
+
+    for (uint8_t pulse = 0; (pulse < 9U) && (PORT_PinRead(I2C_SDA_PIN) == false); pulse++)
+    {
+        i2cLineLow(I2C_SCL_PIN);
+        delayCycles(I2C_RECOVERY_HALF_PERIOD_CYCLES);
+        i2cLineRelease(I2C_SCL_PIN);
+        delayCycles(I2C_RECOVERY_HALF_PERIOD_CYCLES);
+    }
+
+    // STOP condition: SDA rises while SCL is high
+    i2cLineLow(I2C_SDA_PIN);
+    delayCycles(I2C_RECOVERY_HALF_PERIOD_CYCLES);
+    i2cLineRelease(I2C_SCL_PIN);
+    delayCycles(I2C_RECOVERY_HALF_PERIOD_CYCLES);
+    i2cLineRelease(I2C_SDA_PIN);
+    delayCycles(I2C_RECOVERY_HALF_PERIOD_CYCLES);
+
+    PORT_PinPeripheralFunctionConfig(I2C_SDA_PIN, I2C_PIN_FUNCTION);
+    PORT_PinPeripheralFunctionConfig(I2C_SCL_PIN, I2C_PIN_FUNCTION);
+    SERCOM2_I2C_Initialize();
+    SERCOM2_I2C_CallbackRegister(i2cEventHandler, 0);
+#if APP_I2C_DMA_ENABLE
+    DMAC_ChannelDisable(I2C_DMA_CHANNEL);
+    memset(i2cPointerValid, 0, sizeof(i2cPointerValid));
+#endif
+    i2cErrors.recoveries++;
+}
+
+// Check whether a host byte is waiting in the X2Cscope USART receiver
+static bool x2cscopeRxPending(void)
 {
-    changeTempSamplingRate = true;      
+    return (X2CSCOPE_USART_REGS->USART_INT.SERCOM_INTFLAG & SERCOM_USART_INT_INTFLAG_RXC_Msk) != 0U;
 }
 
-// RTC event handler
-static void rtcEventHandler (RTC_TIMER32_INT_MASK intCause, uintptr_t context)
+// Serve the host and account the calls in linkStats. X2Cscope_Communicate()
+// moves at most one byte per call in each direction, so while the link is
+// busy it is called in a bounded burst: received bytes are drained and the
+// reply is fed to the transmitter as fast as it takes them, instead of one
+// byte per main loop pass. The burst ends once nothing is received and the
+// last call either wrote no byte or left the transmitter full (DRE clear).
+// A write is seen as DRE or TXC dropping across the call; TXC alone is not
+// enough, it reads clear after reset until the first byte went out.
+static void x2cscopeService(void)
 {
-    if (intCause & RTC_MODE0_INTENSET_CMP0_Msk)
-    {            
-        isRTCTimerExpired = true;                              
+    uint8_t before;
+    uint8_t flags;
+    bool rxPending;
+    bool written;
+
+    if (linkStatsReset == true)
+    {
+        memset(&linkStats, 0, sizeof(linkStats));
+        linkStatsReset = false;
+    }
+    for (uint8_t n = 0; n < X2CSCOPE_SERVICE_BURST; n++)
+    {
+        rxPending = x2cscopeRxPending();
+        before = X2CSCOPE_USART_REGS->USART_INT.SERCOM_INTFLAG;
+        X2Cscope_Communicate();
+        linkStats.communicateCalls++;
+        flags = X2CSCOPE_USART_REGS->USART_INT.SERCOM_INTFLAG;
+        if (rxPending == true)
+        {
+            if ((flags & SERCOM_USART_INT_INTFLAG_RXC_Msk) == 0U)
+            {
+                linkStats.rxBytes++;
+            }
+            continue;
+        }
+        written = ((before & ~flags) &
+                   (SERCOM_USART_INT_INTFLAG_TXC_Msk | SERCOM_USART_INT_INTFLAG_DRE_Msk)) != 0U;
+        if ((written == false) || ((flags & SERCOM_USART_INT_INTFLAG_DRE_Msk) == 0U))
+        {
+            break;
+        }
     }
 }
 
-// I2C event handler
-static void i2cEventHandler(uintptr_t contextHandle)
+// Switch the host link to a newly requested baud rate. Unsupported values
+// are refused by restoring the request to the active rate.
+static void x2cscopeBaudUpdate(void)
 {
-    if (SERCOM2_I2C_ErrorGet() == SERCOM_I2C_ERROR_NONE)
+    uint32_t baud = x2cscopeBaudRequest;
+    USART_SERIAL_SETUP setup;
+    bool valid = false;
+
+    if (baud == x2cscopeBaud)
+    {
+        return;
+    }
+    for (uint8_t i = 0; i < (sizeof(x2cscopeBaudRates) / sizeof(x2cscopeBaudRates[0])); i++)
+    {
+        valid |= (x2cscopeBaudRates[i] == baud);
+    }
+    if (valid == false)
     {
-        isTemperatureRead = true;
+        x2cscopeBaudRequest = x2cscopeBaud;
+        return;
+    }
+    // Let the acknowledge of the write finish at the old rate first
+    if ((X2CSCOPE_USART_REGS->USART_INT.SERCOM_INTFLAG & SERCOM_USART_INT_INTFLAG_TXC_Msk) == 0U)
+    {
+        return;
+    }
+    setup.baudRate = baud;
+    setup.parity = USART_PARITY_NONE;
+    setup.dataWidth = USART_DATA_8_BIT;
+    setup.stopBits = USART_STOP_1_BIT;
+    if (X2CSCOPE_USART_SERIAL_SETUP(&setup, 0U) == true)
+    {
+        x2cscopeBaud = baud;
+    }
+    else
+    {
+        x2cscopeBaudRequest = x2cscopeBaud;
     }
 }
 
-// USART DMA channel handler
-static void usartDmaChannelHandler(DMAC_TRANSFER_EVENT event, uintptr_t contextHandle)
+#if APP_LOW_POWER_ENABLE
+// Configure IDLE sleep and let the X2Cscope receiver wake the core. With
+// SEVONPEND any interrupt becoming pending wakes WFE, even one that is not
+// enabled in the NVIC, so the USART RXC flag needs no handler of its own.
+static void lowPowerInitialize(void)
 {
-    if (event == DMAC_TRANSFER_EVENT_COMPLETE)
+    PM_REGS->PM_SLEEPCFG = PM_SLEEPCFG_SLEEPMODE_IDLE;
+    SCB->SCR = (SCB->SCR & ~SCB_SCR_SLEEPDEEP_Msk) | SCB_SCR_SEVONPEND_Msk;
+    X2CSCOPE_USART_REGS->USART_INT.SERCOM_INTENSET = SERCOM_USART_INT_INTENSET_RXC_Msk;
+}
+
+// Sleep until the next interrupt when the main loop has nothing to do.
+// IDLE keeps TC0, RTC, DMA and the SERCOMs clocked; each of their interrupts
+// (and the 1 ms X2Cscope tick) ends the sleep.
+static void lowPowerIdle(void)
+{
+    __disable_irq();
+    if ((appEventHead == appEventTail) && (x2cscopeAwakeTicks == 0U) &&
+        (x2cscopeRxPending() == false))
     {
-        isUSARTTxComplete = true;
+        linkStats.idleEntries++;
+        __DSB();
+        __WFE();
     }
+    __enable_irq();
+    // Re-arm the RXC wake-up for the next host byte
+    NVIC_ClearPendingIRQ(X2CSCOPE_USART_IRQn);
 }
+#endif // APP_LOW_POWER_ENABLE
 
-// 1ms callback for the X2C update
-static void TC0_Callback_InterruptHandler(TC_TIMER_STATUS status, uintptr_t context)
+// *****************************************************************************
+// *****************************************************************************
+// Section: Application Event Handlers
+// *****************************************************************************
+// *****************************************************************************
+
+// First-order IIR low-pass on the primary sensor, integer only
+static int16_t tempFilterUpdate(int16_t tempQ8)
 {
-        // Keep this fast; just push samples to the X2Cscope buffer
-        X2Cscope_Update();
+    uint32_t alpha = tempFilterAlpha;
+    int32_t error;
+
+    if (alpha > TEMP_FILTER_ALPHA_ONE)
+    {
+        alpha = TEMP_FILTER_ALPHA_ONE;
+    }
+    if (tempFilterPrimed == false)
+    {
+        tempFilterState = (int32_t)tempQ8 << 8;
+        tempFilterPrimed = true;
+    }
+    error = ((int32_t)tempQ8 << 8) - tempFilterState;
+    tempFilterState += (int32_t)(((int64_t)error * (int32_t)alpha) >> 15);
+    return (int16_t)(tempFilterState >> 8);
+}
+
+// Decide whether a sample is reported; always true unless report by
+// exception is enabled
+static bool reportIsDue(int16_t tempQ8)
+{
+    int32_t delta = (int32_t)tempQ8 - reportLastQ8;
+
+    if (delta < 0)
+    {
+        delta = -delta;
+    }
+    if ((reportByException == true) && (delta < (int32_t)reportDeadbandQ8) &&
+        (++reportSilentSamples < reportHeartbeat))
+    {
+        return false;
+    }
+    reportLastQ8 = tempQ8;
+    reportSilentSamples = 0;
+    reportChangeCount++;
+    return true;
+}
+
+#if APP_STATS_ENABLE
+// Add one value to a statistics channel
+static void statsChannelAdd(STATS_CHANNEL* channel, int32_t value)
+{
+    int32_t x = value * 256;
+    int32_t delta = x - channel->mean;
+    int32_t half;
+    uint64_t variance;
+
+    channel->count++;
+    if (channel->count == 1U)
+    {
+        channel->min = value;
+        channel->max = value;
+        channel->mean = x;
+        channel->m2 = 0;
+        channel->variance = 0;
+        return;
+    }
+    if (value < channel->min)
+    {
+        channel->min = value;
+    }
+    if (value > channel->max)
+    {
+        channel->max = value;
+    }
+    // Round the mean step, truncation would bias the mean over a long run
+    half = (int32_t)(channel->count / 2U);
+    channel->mean += (delta + ((delta < 0) ? -half : half)) / (int32_t)channel->count;
+    // With the updated mean between the old one and x the product is never negative
+    channel->m2 += (int64_t)delta * (x - channel->mean);
+    variance = ((uint64_t)channel->m2 / (channel->count - 1U)) >> 8;
+    channel->variance = (variance > UINT32_MAX) ? UINT32_MAX : (uint32_t)variance;
+}
+
+// Account the primary sensor of a completed scan
+static void statsUpdate(const I2C_SCAN_RESULT* scan)
+{
+    int16_t tempQ8 = scan->tempQ8[0];
+    uint32_t timestamp = scan->timestamp;
+
+    if (statsReset == true)
+    {
+        memset(&stats, 0, sizeof(stats));
+        statsReset = false;
+    }
+    statsChannelAdd(&stats.temperature, tempQ8);
+    if ((statsLastValid == true) && (scan->irregular == false))
+    {
+        statsChannelAdd(&stats.jitter,
+                (int32_t)(timestamp - statsLastTimestamp - (scan->period + 1U)));
+    }
+    statsLastTimestamp = timestamp;
+    statsLastValid = true;
+}
+#endif // APP_STATS_ENABLE
+
+#if APP_LOG_ENABLE
+// Queue the log line or binary frame of the primary sensor; the message is
+// dropped if the transmit queue is full
+static void appLogSample(const I2C_SCAN_RESULT* scan)
+{
+    uint8_t* txSlot = logReserve();
+
+    if (txSlot != NULL)
+    {
+        if (telemetryMode == TELEMETRY_MODE_BINARY)
+        {
+            logCommit(uartFormatFrame(txSlot, scan->timestamp, scan->raw));
+        }
+        else
+        {
+            logCommit(uartFormatTemperature(txSlot, temperatureVal, scan->timestamp));
+        }
+    }
+}
+
+// Announce a new sampling period on the log
+static void appLogPeriod(uint32_t period)
+{
+    uint8_t* txSlot;
+
+    // In binary mode the next frame carries the new rate, keep the stream free of text
+    if (telemetryMode != TELEMETRY_MODE_ASCII)
+    {
+        return;
+    }
+    txSlot = logReserve();
+    if (txSlot == NULL)
+    {
+        return;
+    }
+    if (tempSampleRate < TEMP_SAMPLING_RATE_COUNT)
+    {
+        logCommit(uartFormatMessage(txSlot, &samplingRates[tempSampleRate].message));
+    }
+    else
+    {
+        logCommit(uartFormatPeriod(txSlot, period));
+    }
+}
+#endif // APP_LOG_ENABLE
+
+// Copy the exported state into the telemetry block
+static void appTelemetryUpdate(void)
+{
+    uint8_t flags = 0;
+
+#if APP_LOG_ENABLE
+    if (telemetryMode == TELEMETRY_MODE_BINARY)
+    {
+        flags |= APP_TELEMETRY_FLAG_BINARY_LOG;
+    }
+    telemetry.uartDrops = logDropCount;
+#endif
+    if (reportByException == true)
+    {
+        flags |= APP_TELEMETRY_FLAG_REPORT_BY_EXCEPTION;
+    }
+    telemetry.sampleRate = (uint8_t)tempSampleRate;
+    telemetry.temperature = TemperatureValueX2C;
+    telemetry.temperatureQ8 = TemperatureQ8X2C;
+    telemetry.filteredQ8 = TemperatureFilteredQ8X2C;
+    telemetry.timestamp = TemperatureTimestampX2C;
+    telemetry.samplePeriod = tempSamplePeriodApplied;
+    telemetry.missedReads = i2cMissedReads;
+    telemetry.i2cNak = i2cErrors.nak;
+    telemetry.i2cBus = i2cErrors.bus;
+    telemetry.reportCount = reportChangeCount;
+    telemetry.eventOverflows = appEventOverflows;
+    telemetry.sensorsValid = (uint8_t)appScanValid;
+    telemetry.flags = flags;
+}
+
+// Publish and log the primary sensor of a completed scan
+static void appTemperatureRead(const I2C_SCAN_RESULT* scan)
+{
+    uint32_t timestamp;
+    bool report;
+
+    appScanValid = scan->valid;
+    for (uint8_t job = 0; job < TEMP_SENSOR_COUNT; job++)
+    {
+        if ((scan->valid & (1UL << job)) != 0U)
+        {
+            TempSensorQ8X2C[job] = scan->tempQ8[job];
+        }
+    }
+    if ((scan->valid & 1UL) == 0U)
+    {
+        // Primary sensor did not answer, nothing to publish
+#if APP_STATS_ENABLE
+        statsLastValid = false;
+#endif
+        appTelemetryUpdate();
+        return;
+    }
+
+    // Get the temperature value; the history keeps every sample
+    temperatureQ8 = scan->tempQ8[0];
+    timestamp = scan->timestamp;
+    TemperatureTimestampX2C = timestamp;
+    temperatureVal = getTemperature(temperatureQ8);
+    TemperatureValueX2C = temperatureVal;
+    TemperatureQ8X2C = temperatureQ8;
+    TemperatureFilteredQ8X2C = tempFilterUpdate(temperatureQ8);
+    telemetry.sampleCount++;
+#if APP_STATS_ENABLE
+    statsUpdate(scan);
+#endif
+#if APP_SAMPLE_HISTORY_ENABLE
+    sampleHistoryPush(timestamp, temperatureQ8);
+#endif
+    report = reportIsDue(temperatureQ8);
+    appTelemetryUpdate();
+    if (report == false)
+    {
+        return;
+    }
+
+    // Print it
+    x2cscopeSampleRequest = true;
+#if APP_LOG_ENABLE
+    appLogSample(scan);
+#endif
+#if APP_LED_TOGGLE_ENABLE
+    // Toggle LED1
+    LED1_Toggle();
+#endif
+}
+
+// Hand a new sampling period to the RTC handler, which programs it at the
+// next match, and announce it on the log
+static void appSamplingPeriodApply(uint32_t period)
+{
+    tempSamplePeriod = period;
+    tempSamplePeriodPending = period;
+    appTelemetryUpdate();
+#if APP_LOG_ENABLE
+    appLogPeriod(period);
+#endif
+}
+
+// Step to the next sampling rate after a button press; a host-selected
+// period goes back to the first entry of the table
+static void appSamplingRateChange(void)
+{
+    tempSampleRate = (tempSampleRate >= (TEMP_SAMPLING_RATE_COUNT - 1)) ?
+            TEMP_SAMPLING_RATE_500MS : (TEMP_SAMPLING_RATE)(tempSampleRate + 1);
+    appSamplingPeriodApply(samplingRates[tempSampleRate].period);
+}
+
+// Apply a period written by the host through X2Cscope
+static void appSamplingPeriodUpdate(void)
+{
+    uint32_t period = tempSamplePeriod;
+
+    if (period == tempSamplePeriodPending)
+    {
+        return;
+    }
+    if (period < PERIOD_MIN)
+    {
+        period = PERIOD_MIN;
+    }
+    else if (period > PERIOD_MAX)
+    {
+        period = PERIOD_MAX;
+    }
+    tempSampleRate = TEMP_SAMPLING_RATE_CUSTOM;
+    for (uint8_t rate = 0; rate < TEMP_SAMPLING_RATE_COUNT; rate++)
+    {
+        if (samplingRates[rate].period == period)
+        {
+            tempSampleRate = (TEMP_SAMPLING_RATE)rate;
+        }
+    }
+    appSamplingPeriodApply(period);
+}
+
+#if APP_SETTINGS_ENABLE
+// Address of a settings page
+static uint32_t settingsPageAddress(uint8_t page)
+{
+    return SETTINGS_NVM_ADDRESS + ((uint32_t)page * NVMCTRL_RWWEEPROM_PAGESIZE);
+}
+
+// Copy the current configuration into a record
+static void settingsCapture(APP_SETTINGS* record, uint32_t sequence)
+{
+    memset(record, 0, sizeof(*record));
+    record->magic = APP_SETTINGS_MAGIC;
+    record->version = APP_SETTINGS_VERSION;
+    record->size = sizeof(APP_SETTINGS);
+    record->sequence = sequence;
+    record->samplePeriod = tempSamplePeriod;
+    record->filterAlpha = tempFilterAlpha;
+    record->reportDeadbandQ8 = reportDeadbandQ8;
+    record->reportHeartbeat = reportHeartbeat;
+    record->oversample = tempOversample;
+#if APP_LOG_ENABLE
+    record->telemetryMode = (uint8_t)telemetryMode;
+#endif
+    record->reportByException = (reportByException == true) ? 1U : 0U;
+    record->crc = telemetryCrc16((const uint8_t*)record, offsetof(APP_SETTINGS, crc));
+}
+
+static bool settingsValid(const APP_SETTINGS* record)
+{
+    return (record->magic == APP_SETTINGS_MAGIC) && (record->version == APP_SETTINGS_VERSION) &&
+           (record->size == sizeof(APP_SETTINGS)) &&
+           (record->crc == telemetryCrc16((const uint8_t*)record, offsetof(APP_SETTINGS, crc)));
+}
+
+// Load a record into the configuration; the sampling period takes effect
+// through appSamplingPeriodUpdate() like a host write
+static void settingsApply(const APP_SETTINGS* record)
+{
+    tempSamplePeriod = record->samplePeriod;
+    tempFilterAlpha = (record->filterAlpha > TEMP_FILTER_ALPHA_ONE) ?
+            TEMP_FILTER_ALPHA_ONE : record->filterAlpha;
+    reportDeadbandQ8 = record->reportDeadbandQ8;
+    reportHeartbeat = record->reportHeartbeat;
+    tempOversample = ((record->oversample == 0U) || (record->oversample > TEMP_OVERSAMPLE_MAX)) ?
+            1U : record->oversample;
+#if APP_LOG_ENABLE
+    telemetryMode = (record->telemetryMode == (uint8_t)TELEMETRY_MODE_BINARY) ?
+            TELEMETRY_MODE_BINARY : TELEMETRY_MODE_ASCII;
+#endif
+    reportByException = (record->reportByException != 0U);
+}
+
+// Restore the newest valid record, right after SYS_Initialize(). The
+// built-in configuration is kept for SETTINGS_COMMAND_DEFAULTS.
+static void settingsLoad(void)
+{
+    const APP_SETTINGS* record = (const APP_SETTINGS*)settingsPageBuffer;
+    APP_SETTINGS newest;
+    bool found = false;
+
+    settingsCapture(&settingsDefaults, 0);
+    for (uint8_t page = 0; page < SETTINGS_NVM_PAGES; page++)
+    {
+        if ((NVMCTRL_RWWEEPROM_Read(settingsPageBuffer, sizeof(settingsPageBuffer),
+                settingsPageAddress(page)) == false) || (settingsValid(record) == false))
+        {
+            continue;
+        }
+        if ((found == false) || ((int32_t)(record->sequence - newest.sequence) > 0))
+        {
+            newest = *record;
+            settingsPage = (uint8_t)((page + 1U) % SETTINGS_NVM_PAGES);
+            found = true;
+        }
+    }
+    if (found == true)
+    {
+        settingsApply(&newest);
+        settingsSequence = newest.sequence;
+        settingsStatus = SETTINGS_STATUS_LOADED;
+    }
+}
+
+// Run a commit requested by the host one step per main loop pass, so
+// X2Cscope stays serviced while the NVM erases and writes
+static void settingsUpdate(void)
+{
+    uint32_t address = settingsPageAddress(settingsPage);
+
+    if ((settingsStep != SETTINGS_STEP_IDLE) && (NVMCTRL_IsBusy() == true))
+    {
+        return;
+    }
+    switch (settingsStep)
+    {
+        case SETTINGS_STEP_IDLE:
+            if (settingsCommand == SETTINGS_COMMAND_NONE)
+            {
+                return;
+            }
+            if (settingsCommand == SETTINGS_COMMAND_DEFAULTS)
+            {
+                settingsApply(&settingsDefaults);
+            }
+            settingsCommand = SETTINGS_COMMAND_NONE;
+            settingsStatus = SETTINGS_STATUS_BUSY;
+            memset(settingsPageBuffer, 0xFF, sizeof(settingsPageBuffer));
+            settingsCapture((APP_SETTINGS*)settingsPageBuffer, settingsSequence + 1U);
+            if ((settingsPage % SETTINGS_NVM_PAGES_PER_ROW) == 0U)
+            {
+                // Entering a row: the other row still holds the current record
+                NVMCTRL_RWWEEPROM_RowErase(address);
+                settingsStep = SETTINGS_STEP_ERASE;
+            }
+            else
+            {
+                settingsStep = SETTINGS_STEP_WRITE;
+            }
+            break;
+        case SETTINGS_STEP_ERASE:
+            settingsStep = SETTINGS_STEP_WRITE;
+            break;
+        case SETTINGS_STEP_WRITE:
+            NVMCTRL_RWWEEPROM_PageWrite(settingsPageBuffer, address);
+            settingsStep = SETTINGS_STEP_VERIFY;
+            break;
+        case SETTINGS_STEP_VERIFY:
+        {
+            APP_SETTINGS written = *(const APP_SETTINGS*)settingsPageBuffer;
+
+            if ((NVMCTRL_RWWEEPROM_Read(settingsPageBuffer, sizeof(settingsPageBuffer), address) == true) &&
+                (memcmp(&written, settingsPageBuffer, sizeof(written)) == 0))
+            {
+                settingsSequence = written.sequence;
+                settingsStatus = SETTINGS_STATUS_SAVED;
+            }
+            else
+            {
+                settingsStatus = SETTINGS_STATUS_ERROR;
+            }
+            // A failed page is skipped, the next attempt uses a fresh one
+            settingsPage = (uint8_t)((settingsPage + 1U) % SETTINGS_NVM_PAGES);
+            settingsStep = SETTINGS_STEP_IDLE;
+            break;
+        }
+        default:
+            settingsStep = SETTINGS_STEP_IDLE;
+            break;
+    }
 }
+#endif // APP_SETTINGS_ENABLE
 
 // *****************************************************************************
 // *****************************************************************************
@@ -130,84 +2032,122 @@ int main ( void )
 {
     /* Initialize all modules */
     SYS_Initialize ( NULL );
+#if APP_SETTINGS_ENABLE
+    settingsLoad();
+#endif
     // Register callback functions for I2C, DMA, RTC, and EIC
     SERCOM2_I2C_CallbackRegister(i2cEventHandler, 0);
-    DMAC_ChannelCallbackRegister(DMAC_CHANNEL_0, usartDmaChannelHandler, 0);
+#if APP_I2C_DMA_ENABLE
+    DMAC_ChannelCallbackRegister(I2C_DMA_CHANNEL, i2cDmaChannelHandler, 0);
+#endif
+#if APP_LOG_BACKEND == APP_LOG_BACKEND_UART
+    DMAC_ChannelCallbackRegister(LOG_DMA_CHANNEL, usartDmaChannelHandler, 0);
+#endif
     RTC_Timer32CallbackRegister(rtcEventHandler, 0);
     EIC_CallbackRegister(EIC_PIN_15,EIC_User_Handler, 0);
     
     /* Register callback function for TC3 period interrupt */
     TC0_TimerCallbackRegister(TC0_Callback_InterruptHandler, (uintptr_t)NULL);
+#if APP_I2C_DMA_ENABLE
+    // i2cEventHandler now also runs from the DMA completion and the TC0
+    // timeout, and the RTC starts the scans. The handler state, its profile
+    // section and rtcTimestampGet() assume none of them preempts another.
+    NVIC_SetPriority(DMAC_IRQn, I2C_IRQ_PRIORITY);
+    NVIC_SetPriority(SERCOM2_IRQn, I2C_IRQ_PRIORITY);
+    NVIC_SetPriority(TC0_IRQn, I2C_IRQ_PRIORITY);
+    NVIC_SetPriority(RTC_IRQn, I2C_IRQ_PRIORITY);
+#endif
+
+    cycleCounterInitialize();
 
     /* Start the timer*/
     TC0_TimerStart();
 
+#if APP_LOW_POWER_ENABLE
+    lowPowerInitialize();
+#endif
+
+    APP_EVENT event;
+    I2C_SCAN_RESULT scan;
+
+#if APP_LOG_ENABLE
     // Print start message
-    sprintf((char*)uartTxBuffer, "Start Of Program \r\n");
+    uint8_t* txSlot = logReserve();
+    if (txSlot != NULL)
+    {
+        logCommit(uartFormatMessage(txSlot, &startMessage));
+    }
+#endif
+    // Program a restored sampling period before the first match; the RTC is
+    // not counting yet, so it does not have to wait for the RTC handler
+    appSamplingPeriodUpdate();
+    tempSamplePeriodApplied = tempSamplePeriodPending;
+    RTC_Timer32CompareSet(tempSamplePeriodApplied);
     // Start the RTC timer
     RTC_Timer32Start();
 
     while ( true )
     {
-        X2Cscope_Communicate();
-        // Check if RTC timer has expired
-        if (isRTCTimerExpired == true)
+        uint32_t loopStart = profileStart();
+        uint32_t start;
+
+#if APP_LOW_POWER_ENABLE
+        if (x2cscopeRxPending() == true)
         {
-            isRTCTimerExpired = false;
-            // Initiate I2C read for temperature sensor
-            SERCOM2_I2C_WriteRead(TEMP_SENSOR_SLAVE_ADDR, &i2cWrData, 1, i2cRdData, 2);
+            x2cscopeAwakeTicks = X2CSCOPE_AWAKE_TICKS;
         }
-        // Check if temperature read is complete
-        if (isTemperatureRead == true)
+#endif
+        linkStats.loopIterations++;
+        start = profileStart();
+        x2cscopeService();
+        profileStop(PROFILE_SECTION_X2C_COMMUNICATE, start);
+        x2cscopeBaudUpdate();
+        profileUpdate();
+        appSamplingPeriodUpdate();
+#if APP_SETTINGS_ENABLE
+        settingsUpdate();
+#endif
+        // Handle one event per pass so X2Cscope is serviced in between
+        if (appEventGet(&event) == true)
         {
-            isTemperatureRead = false;
-            if(changeTempSamplingRate == false)
+            switch (event)
             {
-                // Get the temperature value and print it
-                temperatureVal = getTemperature(i2cRdData);
-                TemperatureValueX2C = temperatureVal;
-                sprintf((char*)uartTxBuffer, "Temperature = %02d C\r\n", temperatureVal);
-                // Toggle LED1
-                LED1_Toggle();
-            }
-            else
-            {
-                changeTempSamplingRate = false;
-                // Change the temperature sampling rate based on current rate
-                if(tempSampleRate == TEMP_SAMPLING_RATE_500MS)
-                {
-                    tempSampleRate = TEMP_SAMPLING_RATE_1S;
-                    sprintf((char*)uartTxBuffer, "Sampling Temperature every 1 second \r\n");
-                    RTC_Timer32CompareSet(PERIOD_1S);
-                }
-                else if(tempSampleRate == TEMP_SAMPLING_RATE_1S)
-                {
-                    tempSampleRate = TEMP_SAMPLING_RATE_2S;
-                    sprintf((char*)uartTxBuffer, "Sampling Temperature every 2 seconds \r\n");        
-                    RTC_Timer32CompareSet(PERIOD_2S);                        
-                }
-                else if(tempSampleRate == TEMP_SAMPLING_RATE_2S)
-                {
-                    tempSampleRate = TEMP_SAMPLING_RATE_4S;
-                    sprintf((char*)uartTxBuffer, "Sampling Temperature every 4 seconds \r\n");        
-                    RTC_Timer32CompareSet(PERIOD_4S);                                        
-                }    
-                else if(tempSampleRate == TEMP_SAMPLING_RATE_4S)
-                {
-                    tempSampleRate = TEMP_SAMPLING_RATE_500MS;
-                    sprintf((char*)uartTxBuffer, "Sampling Temperature every 500 ms \r\n");        
-                    RTC_Timer32CompareSet(PERIOD_500MS);
-                }
-                else
-                {
-                    ;
-                }
+                case APP_EVENT_TEMPERATURE_READ:
+                    // Everything completed so far; an event whose scan was
+                    // already taken finds the ring empty
+                    while (i2cScanResultGet(&scan) == true)
+                    {
+                        appTemperatureRead(&scan);
+                    }
+                    break;
+                case APP_EVENT_RATE_CHANGE:
+                    appSamplingRateChange();
+                    break;
+#if APP_LOG_BACKEND == APP_LOG_BACKEND_UART
+                case APP_EVENT_UART_TX_ERROR:
+                    logDropCount++;
+                    break;
+#endif
+                case APP_EVENT_I2C_BUS_ERROR:
+                    i2cBusRecover();
+                    // Publish what the aborted scan collected so far
+                    i2cScanFinish();
+                    i2cRecoveryPending = false;
+                    i2cScanActive = false;
+                    while (i2cScanResultGet(&scan) == true)
+                    {
+                        appTemperatureRead(&scan);
+                    }
+                    break;
+                default:
+                    break;
             }
-            // Initiate DMA transfer for UART transmission
-            DMAC_ChannelTransfer(DMAC_CHANNEL_0, uartTxBuffer, \
-                    (const void *)&(SERCOM1_REGS->USART_INT.SERCOM_DATA), \
-                    strlen((const char*)uartTxBuffer));
         }
+        profileStop(PROFILE_SECTION_MAIN_LOOP, loopStart);
+#if APP_LOW_POWER_ENABLE
+        // Nothing pending: sleep until the next interrupt
+        lowPowerIdle();
+#endif
     }
 
     /* Execution should not come here during normal operation */
@@ -14,21 +14,32 @@ pyX2Cscope motor logger GUI  –  with per-channel scaling
 • New **Scaling** tab lets you type a multiplier for each variable
   (default 1.0).  The capture thread applies it on the fly, so plots
   and saved files show scaled values.
+• Captures stream to a temporary CSV while running and only the newest
+  samples stay in memory for the plots, so long captures keep a flat
+  memory footprint.  Save converts to Excel, MATLAB, CSV or Parquet.
 
 Tested with: pyX2Cscope 0.4.4, Python 3.11, Windows 10.
 """
 
 from __future__ import annotations
 
+import csv
+import math
+import os
 import pathlib
+import shutil
+import tempfile
 import threading
 import time
+from array import array
 import tkinter as tk
 from tkinter import filedialog, messagebox, ttk
 from typing import Dict, List, Union
 
 import serial.tools.list_ports
 
+from scope_common import AcquisitionEngine, BlockReader, connect_scope
+
 # ─── Optional runtime deps (plot & save) ──────────────────────────────────────
 try:
     import matplotlib.pyplot as plt
@@ -36,6 +47,11 @@ try:
 except ImportError:  # pragma: no cover
     plt = None  # type: ignore
 
+try:
+    import numpy as np  # type: ignore
+except ImportError:  # pragma: no cover
+    np = None  # type: ignore
+
 try:
     import pandas as pd  # type: ignore
 except ImportError:  # pragma: no cover
@@ -92,8 +108,7 @@ class _ScopeWrapper:
 
     def connect(self, port: str, elf: str):
         if USE_SCOPE:
-            self._scope = X2CScope(port=port)
-            self._scope.import_variables(elf)
+            self._scope = connect_scope(port, elf)
 
     def get_variable(self, path: str):
         if not USE_SCOPE:
@@ -102,6 +117,14 @@ class _ScopeWrapper:
             raise RuntimeError("Scope not connected")
         return self._scope.get_variable(path)
 
+    def read_block(self, vars: List[object]) -> BlockReader:
+        """Reader fetching ``vars`` with merged X2Cscope RAM requests.
+
+        Keep the returned reader and call ``read()`` on each poll; the
+        address plan is computed only once.
+        """
+        return BlockReader(vars)
+
     def disconnect(self):
         if USE_SCOPE and self._scope:
             self._scope.disconnect()
@@ -138,6 +161,121 @@ class _ScopeWrapper:
         if USE_SCOPE and self._scope:
             self._scope.request_scope_data()
 
+# ─── Capture storage ─────────────────────────────────────────────────────────
+# A capture streams every block to a spool CSV as it arrives and keeps only
+# the newest RING_SAMPLES in memory for the plots, so memory stays flat no
+# matter how long the capture runs.  "Save…" converts the spool afterwards.
+RING_SAMPLES = 200_000   # samples per column kept for plotting
+SAVE_CHUNK_ROWS = 50_000  # rows per chunk when converting the spool
+
+
+class CaptureStore:
+    """Ring of recent samples plus an incremental CSV spool on disk."""
+
+    def __init__(self, columns: List[str], capacity: int = RING_SAMPLES):
+        self.columns = list(columns)
+        self.capacity = capacity
+        self.count = 0          # samples written since start
+        self.missing = 0        # values absent from their block, stored as NaN
+        if np is not None:
+            self._ring = {c: np.zeros(capacity) for c in self.columns}
+        else:
+            self._ring = {c: array("d", bytes(8 * capacity)) for c in self.columns}
+        fd, self.spool_path = tempfile.mkstemp(prefix="motorlogger_", suffix=".csv")
+        self._spool = os.fdopen(fd, "w", newline="")
+        self._csv = csv.writer(self._spool)
+        self._csv.writerow(self.columns)
+
+    def append(self, block: Dict[str, List[float]]) -> None:
+        """Add one block of columns, as long as the first one.
+
+        Values a channel did not deliver (missing or short column) are
+        stored as NaN and counted in :attr:`missing`, never invented.
+        """
+        n = len(block[self.columns[0]])
+        if n == 0:
+            return
+        cols = []
+        for c in self.columns:
+            vals = list(block.get(c) or [])[:n]
+            if len(vals) < n:
+                self.missing += n - len(vals)
+                vals += [math.nan] * (n - len(vals))
+            cols.append(vals)
+        self._csv.writerows(zip(*cols))
+        for name, vals in zip(self.columns, cols):
+            if len(vals) > self.capacity:
+                vals = vals[-self.capacity:]
+            self._store(self._ring[name], self.count + n - len(vals), vals)
+        self.count += n
+
+    def _store(self, ring, start: int, vals) -> None:
+        pos = start % self.capacity
+        first = min(len(vals), self.capacity - pos)
+        if np is not None:
+            ring[pos:pos + first] = vals[:first]
+            ring[:len(vals) - first] = vals[first:]
+        else:
+            ring[pos:pos + first] = array("d", vals[:first])
+            ring[:len(vals) - first] = array("d", vals[first:])
+
+    def close(self) -> None:
+        if not self._spool.closed:
+            self._spool.close()
+
+    def discard(self) -> None:
+        self.close()
+        try:
+            os.remove(self.spool_path)
+        except OSError:
+            pass
+
+    @property
+    def truncated(self) -> bool:
+        """True when the plots only see the newest part of the capture."""
+        return self.count > self.capacity
+
+    def column(self, name: str):
+        """Samples of ``name`` still held in memory, oldest first."""
+        ring = self._ring[name]
+        if self.count <= self.capacity:
+            return ring[:self.count]
+        pos = self.count % self.capacity
+        if np is not None:
+            return np.concatenate((ring[pos:], ring[:pos]))
+        return ring[pos:] + ring[:pos]
+
+    def save(self, fn: str) -> None:
+        """Convert the spool to ``fn``; the format follows the file suffix."""
+        self.close()
+        ext = pathlib.Path(fn).suffix.lower()
+        if ext == ".csv":
+            shutil.copyfile(self.spool_path, fn)
+            return
+        if pd is None: raise RuntimeError("pandas not installed")
+        if ext == ".parquet":
+            # Chunked conversion, memory stays bounded like during capture
+            import pyarrow as pa  # type: ignore
+            import pyarrow.parquet as pq  # type: ignore
+            writer = None
+            try:
+                for chunk in pd.read_csv(self.spool_path, chunksize=SAVE_CHUNK_ROWS):
+                    table = pa.Table.from_pandas(chunk, preserve_index=False)
+                    if writer is None:
+                        writer = pq.ParquetWriter(fn, table.schema)
+                    writer.write_table(table)
+            finally:
+                if writer is not None:
+                    writer.close()
+            return
+        # MAT and Excel files are written in one go and need the whole capture in memory
+        df = pd.read_csv(self.spool_path)
+        if ext == ".mat":
+            if sio is None: raise RuntimeError("scipy not installed")
+            sio.savemat(fn, {c: df[c].to_numpy() for c in df.columns})
+        else:  # Excel
+            df.to_excel(fn, index=False)
+
 # ─── Main GUI ────────────────────────────────────────────────────────────────
 class MotorLoggerGUI:
     GUI_POLL_MS = 500        # live RPM update
@@ -152,7 +290,9 @@ class MotorLoggerGUI:
         self.connected = False
         self._cap_thread: threading.Thread | None = None
         self._stop_flag = threading.Event()
-        self.data: Dict[str, List[float]] = {}
+        self.capture: CaptureStore | None = None
+        # Live speed poll; stopped while a capture owns the link
+        self._speed_engine: AcquisitionEngine | None = None
         self.scale_factors = {k: 1.0 for k in VAR_PATHS}  # per-channel scaling
         self.selected_vars = list(VAR_PATHS)
         self.enforce_limit = DEFAULT_ENFORCE_SAMPLE_LIMIT
@@ -302,6 +442,9 @@ class MotorLoggerGUI:
             self.meas_var = self.scope.get_variable(VEL_MEAS_VAR)
             self.run_var  = self.scope.get_variable(RUN_REQ_VAR)
             self.stop_var = self.scope.get_variable(STOP_REQ_VAR)
+            self.speed_reader = self.scope.read_block([self.meas_var, self.cmd_var])
+            self._speed_engine = AcquisitionEngine(self.speed_reader.read,
+                                                   self.GUI_POLL_MS / 1000.0, maxsize=16)
             self.mon_vars = {k: self.scope.get_variable(p) for k, p in VAR_PATHS.items()}
             missing = [k for k, v in self.mon_vars.items() if v is None]
             if missing:
@@ -313,9 +456,12 @@ class MotorLoggerGUI:
         self.connected = True
         self.conn_btn.config(text="Disconnect"); self.start_btn.config(state="normal")
         self.status.set(f"Connected ({port})")
+        self._speed_engine.start()
 
     def _disconnect(self):
         self._stop_capture()
+        if self._speed_engine is not None:
+            self._speed_engine.stop()
         self.scope.disconnect()
         self.connected = False
         for b in (self.start_btn, self.stop_btn, self.curr_btn, self.omega_btn, self.save_btn):
@@ -355,9 +501,15 @@ class MotorLoggerGUI:
                     f"Minimum allowed interval is {MIN_DELAY_MS:.0f} ms",
                 )
                 return
-        self.data = {k: [] for k in self.selected_vars}
-        self.data["t"] = []
-        self.data["MotorRunning"] = []  # 1 when spinning, 0 after stop command
+        # The capture thread takes over the link from the speed poll, which
+        # must really have ended first
+        if self._speed_engine is not None and not self._speed_engine.stop():
+            messagebox.showwarning("Link busy", "The speed poll is still waiting on the link, try again")
+            return
+        # MotorRunning is 1 while spinning, 0 after the stop command
+        if self.capture is not None:
+            self.capture.discard()
+        self.capture = CaptureStore(["t", *self.selected_vars, "MotorRunning"])
         self._stop_flag.clear(); self.ts = dt_ms / 1000.0
         self.cmd_var.set_value(int(round(rpm/scale)))
 
@@ -414,12 +566,10 @@ class MotorLoggerGUI:
                         n = len(next(iter(chans.values())))  # all lists are equal
 
                         # time vector -------------------------------------
-                        self.data["t"].extend(
-                            [(sample_idx + i) * self.ts for i in range(n)]
-                        )
-                        self.data["MotorRunning"].extend(
-                            [1 if running else 0] * n
-                        )
+                        block: Dict[str, List[float]] = {
+                            "t": [(sample_idx + i) * self.ts for i in range(n)],
+                            "MotorRunning": [1.0 if running else 0.0] * n,
+                        }
                         sample_idx += n
 
                         for ch, vals in chans.items():
@@ -429,11 +579,16 @@ class MotorLoggerGUI:
                             if key is None:                # a channel we don’t care about
                                 continue
                             scale = self.scale_factors[key]
-                            self.data[key].extend(v * scale for v in vals)
-
+                            block[key] = [v * scale for v in vals[:n]]
+                        # Streams to the spool file, memory use stays flat
+                        self.capture.append(block)
+                        continue                           # more may be ready
 
+                # Nothing ready yet: wait a fraction of the sample interval
                 time.sleep(self.ts / 10)
         finally:
+            if self.capture is not None:
+                self.capture.close()
             try:
                 if self.root.winfo_exists():
                     self.root.after(0, self._worker_done)
@@ -444,31 +599,36 @@ class MotorLoggerGUI:
         self.start_btn.config(state="normal")
         self.stop_btn.config(state="disabled")
 
-        if self.data.get("t"):
-            t_len = len(self.data["t"])
-            for k in list(self.data.keys()):
-                if k == "t":
-                    continue
-                if isinstance(self.data[k], list) and len(self.data[k]) != t_len:
-                    self.data[k] = self.data[k][:t_len]
-
-            if any(k in self.data for k in ("idqCmd_q", "Idq_q", "Idq_d")):
+        cols = self.capture.columns if self.capture is not None else []
+        if self.capture is not None and self.capture.count:
+            if any(k in cols for k in ("idqCmd_q", "Idq_q", "Idq_d")):
                 self.curr_btn.config(state="normal")
             else:
                 self.curr_btn.config(state="disabled")
 
-            if any(k in self.data for k in ("OmegaElectrical", "OmegaCmd")):
+            if any(k in cols for k in ("OmegaElectrical", "OmegaCmd")):
                 self.omega_btn.config(state="normal")
             else:
                 self.omega_btn.config(state="disabled")
 
             self.save_btn.config(state="normal")
-            self.status.set("Capture finished")
+            msg = f"Capture finished ({self.capture.count} samples"
+            if self.capture.missing:
+                msg += f", {self.capture.missing} values missing"
+            self.status.set(msg + ")")
         else:
             self.status.set("Stopped / no data")
 
         for w in self._lock_widgets:
             w.config(state="normal")
+        self._resume_speed_poll()
+
+    def _resume_speed_poll(self):
+        """Restart the speed poll once the capture thread has let go of the link."""
+        if not self.connected or self._speed_engine is None:
+            return
+        if (self._cap_thread and self._cap_thread.is_alive()) or not self._speed_engine.start():
+            self.root.after(self.GUI_POLL_MS, self._resume_speed_poll)
 
     # ── Live RPM polling ─────────────────────────────────────────────────
     def _poll_gui(self):
@@ -479,38 +639,43 @@ class MotorLoggerGUI:
             return
         if self._cap_thread and self._cap_thread.is_alive():
             self._poll_job = self.root.after(self.GUI_POLL_MS, self._poll_gui); return
-        if self.connected:
+        samples = self._speed_engine.drain() if self._speed_engine is not None else []
+        if self.connected and samples:
             try:
-                cnt_meas = self.meas_var.get_value(); cnt_cmd = self.cmd_var.get_value()
+                cnt_meas, cnt_cmd = samples[-1][1]
                 scale = float(self.scale_entry.get())
                 self.meas_str.set(f"{cnt_meas*scale:+.0f} RPM ({cnt_meas})")
                 self.cmd_str .set(f"{cnt_cmd *scale:+.0f} RPM ({cnt_cmd})")
             except Exception:
                 self.meas_str.set("—"); self.cmd_str.set("—")
-        else:
+        elif not self.connected:
             self.meas_str.set("—"); self.cmd_str.set("—")
         self._poll_job = self.root.after(self.GUI_POLL_MS, self._poll_gui)
 
     # ── Plot & save ──────────────────────────────────────────────────────
+    def _has_capture(self) -> bool:
+        return self.capture is not None and self.capture.count > 0
+
+    def _plot_title(self, title: str) -> str:
+        if self.capture is not None and self.capture.truncated:
+            return f"{title} (last {self.capture.capacity} samples)"
+        return title
+
     def _plot_currents(self):
-        if not self.data["t"]:
+        if not self._has_capture():
             messagebox.showinfo("No data", "Nothing captured yet"); return
         if plt is None:
             messagebox.showerror("Plot", "Install matplotlib"); return
         fig, ax = plt.subplots(figsize=(8, 4))
-        t = self.data["t"]
+        t = self.capture.column("t")
         plotted = False
         for k, lbl in (
             ("idqCmd_q", "idqCmd.q [A]"),
             ("Idq_q",    "idq.q [A]"),
             ("Idq_d",    "idq.d [A]"),
         ):
-            if (
-                k in self.data
-                and self.data[k]            # not empty
-                and len(self.data[k]) == len(t)
-            ):
-                ax.plot(t, self.data[k], label=lbl, linewidth=0.9)
+            if k in self.capture.columns:
+                ax.plot(t, self.capture.column(k), label=lbl, linewidth=0.9)
                 plotted = True
 
         if not plotted:
@@ -519,28 +684,24 @@ class MotorLoggerGUI:
         ax.set_ylabel("Current [scaled]")
         ax.grid(True, linestyle=":", linewidth=0.5)
         ax.legend(fontsize="small")
-        win = tk.Toplevel(self.root); win.title("Current traces")
+        win = tk.Toplevel(self.root); win.title(self._plot_title("Current traces"))
         FigureCanvasTkAgg(fig, master=win).get_tk_widget().pack(fill="both", expand=True)
         fig.tight_layout()
 
     def _plot_omega(self):
-        if not self.data["t"]:
+        if not self._has_capture():
             messagebox.showinfo("No data", "Nothing captured yet"); return
         if plt is None:
             messagebox.showerror("Plot", "Install matplotlib"); return
         fig, ax = plt.subplots(figsize=(8, 4))
-        t = self.data["t"]
+        t = self.capture.column("t")
         plotted = False
         for k, lbl in (
             ("OmegaElectrical", "omegaElectrical [RPM]"),
             ("OmegaCmd",        "omegaCmd [RPM]"),
         ):
-            if (
-                k in self.data
-                and self.data[k]            # not empty
-                and len(self.data[k]) == len(t)
-            ):
-                ax.plot(t, self.data[k], label=lbl, linewidth=0.9)
+            if k in self.capture.columns:
+                ax.plot(t, self.capture.column(k), label=lbl, linewidth=0.9)
                 plotted = True
 
         if not plotted:
@@ -549,27 +710,19 @@ class MotorLoggerGUI:
         ax.set_ylabel("Omega [scaled]")
         ax.grid(True, linestyle=":", linewidth=0.5)
         ax.legend(fontsize="small")
-        win = tk.Toplevel(self.root); win.title("Omega traces")
+        win = tk.Toplevel(self.root); win.title(self._plot_title("Omega traces"))
         FigureCanvasTkAgg(fig, master=win).get_tk_widget().pack(fill="both", expand=True)
         fig.tight_layout()
 
     def _save(self):
-        if not self.data["t"]:
+        if not self._has_capture():
             messagebox.showinfo("No data", "Nothing to save"); return
         fn = filedialog.asksaveasfilename(defaultextension=".xlsx",
-                                          filetypes=[("Excel","*.xlsx"),("MATLAB","*.mat"),("CSV","*.csv"),("All","*.*")])
+                                          filetypes=[("Excel","*.xlsx"),("MATLAB","*.mat"),("CSV","*.csv"),
+                                                     ("Parquet","*.parquet"),("All","*.*")])
         if not fn: return
-        ext = pathlib.Path(fn).suffix.lower()
         try:
-            if ext == ".mat":
-                if sio is None: raise RuntimeError("scipy not installed")
-                sio.savemat(fn, self.data)
-            elif ext == ".csv":
-                if pd is None: raise RuntimeError("pandas not installed")
-                pd.DataFrame(self.data).to_csv(fn, index=False)
-            else:  # Excel
-                if pd is None: raise RuntimeError("pandas not installed")
-                pd.DataFrame(self.data).to_excel(fn, index=False)
+            self.capture.save(fn)
         except Exception as e:
             messagebox.showerror("Save", str(e)); return
         messagebox.showinfo("Saved", fn)
@@ -585,6 +738,10 @@ class MotorLoggerGUI:
                     pass
             if self._cap_thread and self._cap_thread.is_alive():
                 self._cap_thread.join(timeout=2)
+            if self._speed_engine is not None:
+                self._speed_engine.stop()
+            if self.capture is not None:
+                self.capture.discard()
             self.scope.disconnect()
         finally:
             try:
@@ -0,0 +1,498 @@
+#!/usr/bin/env python3
+"""Helpers shared by the pyX2Cscope GUIs in this repository.
+
+``BlockReader`` fetches a fixed list of variables with as few X2Cscope
+transactions as possible: variables are sorted by address and neighbours
+that lie close together (for example the members of one firmware struct)
+are merged into a single RAM read, which is then split and decoded
+locally.  Polling three values therefore costs one round-trip instead of
+three when they are adjacent in memory.
+
+The reader relies on the ``l_net``/``address``/``get_width``/
+``bytes_to_value`` interface of pyX2Cscope variables.  Objects without it
+(demo variables, other pyX2Cscope versions) are read one by one with
+``get_value()``, so callers can always use it.
+
+``AcquisitionEngine`` runs such reads in a background thread and hands
+the timestamped results to the GUI through a bounded queue, so a slow or
+stalled serial link never blocks the Tk main loop.
+
+``TriggerCapture`` arms the firmware trigger engine of ``main_temp.c`` and
+downloads a completed window, so short transients are caught on the
+device instead of by host polling.
+
+``SoakStats`` polls the firmware's long-run statistics block (``stats``)
+and converts it to engineering units.
+
+``commit_settings`` stores the firmware configuration in its RWW EEPROM so
+the board boots straight into it.
+
+``import_variables_cached`` replaces ``scope.import_variables(elf)``: the
+parsed symbol table is exported once per ELF content hash into a cache
+directory and re-imported from there on later connects, which skips the
+DWARF parse of large images.
+"""
+
+from __future__ import annotations
+
+import hashlib
+import os
+import pathlib
+import queue
+import struct
+import threading
+import time
+from typing import Any, Callable, List, Optional, Sequence, Tuple
+
+# Largest single RAM read; keeps each request within one LNet frame
+BLOCK_MAX_BYTES = 64
+# Merge two variables into one read when at most this many bytes separate them
+BLOCK_GAP_MAX = 8
+
+
+# Symbol cache location, override with the X2C_SYMBOL_CACHE environment variable
+SYMBOL_CACHE_ENV = "X2C_SYMBOL_CACHE"
+
+
+def symbol_cache_dir() -> pathlib.Path:
+    env = os.environ.get(SYMBOL_CACHE_ENV)
+    if env:
+        return pathlib.Path(env)
+    base = os.environ.get("LOCALAPPDATA") or os.environ.get("XDG_CACHE_HOME")
+    root = pathlib.Path(base) if base else pathlib.Path.home() / ".cache"
+    return root / "pyx2cscope_symbols"
+
+
+def elf_cache_key(elf: str) -> str:
+    """SHA-256 of the ELF contents plus the pyX2Cscope version.
+
+    The version is part of the key because the exported table format
+    belongs to pyX2Cscope and may change between releases.
+    """
+    h = hashlib.sha256()
+    with open(elf, "rb") as f:
+        for chunk in iter(lambda: f.read(1 << 20), b""):
+            h.update(chunk)
+    try:
+        from importlib.metadata import version
+        h.update(version("pyx2cscope").encode())
+    except Exception:
+        pass
+    return h.hexdigest()
+
+
+def _export_pickle(scope: Any, stem: pathlib.Path) -> Optional[pathlib.Path]:
+    """Export the imported variables with pyX2Cscope's own exporter."""
+    try:
+        from pyx2cscope.variable.variable_factory import FileType  # type: ignore
+    except Exception:
+        return None
+    for owner in (scope, getattr(scope, "variable_factory", None)):
+        export = getattr(owner, "export_variables", None)
+        if export is None:
+            continue
+        try:
+            export(str(stem), ext=FileType.PICKLE)
+        except Exception:
+            continue
+        out = stem.with_suffix(".pkl")
+        if out.is_file():
+            return out
+    return None
+
+
+def import_variables_cached(scope: Any, elf: str, cache_dir: Optional[pathlib.Path] = None) -> bool:
+    """Import the symbols of ``elf`` into ``scope``, through the on-disk cache.
+
+    Returns True when the cache was used.  Any cache problem (unsupported
+    pyX2Cscope version, stale or unreadable file, read-only directory) falls
+    back to parsing the ELF, so the result is the same either way.
+    """
+    cache_dir = symbol_cache_dir() if cache_dir is None else cache_dir
+    try:
+        stem = cache_dir / elf_cache_key(elf)
+    except OSError:
+        scope.import_variables(elf)
+        return False
+    cached = stem.with_suffix(".pkl")
+    if cached.is_file():
+        try:
+            scope.import_variables(str(cached))
+            return True
+        except Exception:
+            cached.unlink(missing_ok=True)
+    scope.import_variables(elf)
+    try:
+        cache_dir.mkdir(parents=True, exist_ok=True)
+        _export_pickle(scope, stem)
+    except OSError:
+        pass
+    return False
+
+
+def connect_scope(port: str, elf: str) -> Any:
+    """Open X2Cscope on ``port`` and load the symbols of ``elf`` (cached)."""
+    from pyx2cscope.x2cscope import X2CScope  # type: ignore
+
+    scope = X2CScope(port=port)
+    import_variables_cached(scope, elf)
+    return scope
+
+
+def find_serial_port(obj: Any, depth: int = 4) -> Optional[Any]:
+    """pyserial port used by a pyX2Cscope object, searched through its attributes."""
+    try:
+        import serial  # type: ignore
+    except ImportError:
+        return None
+    seen = set()
+
+    def walk(o: Any, d: int) -> Optional[Any]:
+        if isinstance(o, serial.SerialBase):
+            return o
+        if d == 0 or id(o) in seen or not hasattr(o, "__dict__"):
+            return None
+        seen.add(id(o))
+        for v in vars(o).values():
+            found = walk(v, d - 1)
+            if found is not None:
+                return found
+        return None
+
+    return walk(obj, depth)
+
+
+# Rates accepted by x2cscopeBaudRequest in main_temp.c
+LINK_BAUD_RATES = (115200, 230400, 460800, 921600)
+
+
+def set_link_baud(scope: Any, baud: int) -> None:
+    """Switch the firmware and the host port to ``baud``.
+
+    The firmware applies the new rate once the acknowledge of the write has
+    been sent, so the host changes its port right after the write returns
+    and then checks ``x2cscopeBaud`` at the new rate.
+    """
+    if baud not in LINK_BAUD_RATES:
+        raise ValueError(f"unsupported baud rate {baud}")
+    port = find_serial_port(scope)
+    if port is None:
+        raise RuntimeError("serial port of the scope interface not found")
+    scope.get_variable("x2cscopeBaudRequest").set_value(baud)
+    time.sleep(0.02)
+    port.baudrate = baud
+    port.reset_input_buffer()
+    active = int(scope.get_variable("x2cscopeBaud").get_value())
+    if active != baud:
+        raise RuntimeError(f"firmware stayed at {active} baud")
+
+
+def _supports_block(var: Any) -> bool:
+    return all(hasattr(var, a) for a in ("l_net", "address", "get_width", "bytes_to_value"))
+
+
+class BlockReader:
+    """Read a fixed set of variables in merged RAM blocks.
+
+    The read plan is computed once, so create one reader per variable set
+    and call :meth:`read` on every poll.
+    """
+
+    def __init__(self, variables: Sequence[Any]) -> None:
+        self.variables = list(variables)
+        # (start address, size, [(index, offset, width), ...]) per block
+        self._blocks: List[Tuple[int, int, List[Tuple[int, int, int]]]] = []
+        self._single: List[int] = []
+        self._lnet = None
+        self._plan()
+
+    def _plan(self) -> None:
+        fast = []
+        for idx, var in enumerate(self.variables):
+            if var is None:
+                continue  # optional variable missing from the ELF, reads as None
+            if _supports_block(var):
+                fast.append((int(var.address), int(var.get_width()), idx))
+                self._lnet = var.l_net
+            else:
+                self._single.append(idx)
+        fast.sort()
+        for addr, width, idx in fast:
+            if self._blocks:
+                start, size, members = self._blocks[-1]
+                end = max(start + size, addr + width)
+                if addr <= start + size + BLOCK_GAP_MAX and end - start <= BLOCK_MAX_BYTES:
+                    members.append((idx, addr - start, width))
+                    self._blocks[-1] = (start, end - start, members)
+                    continue
+            self._blocks.append((addr, width, [(idx, 0, width)]))
+
+    @property
+    def transactions(self) -> int:
+        """Number of X2Cscope requests one :meth:`read` costs."""
+        return len(self._blocks) + len(self._single)
+
+    def read(self) -> List[Any]:
+        """Return the current values in the order the variables were given."""
+        values: List[Any] = [None] * len(self.variables)
+        for start, size, members in self._blocks:
+            data = bytes(self._lnet.get_ram(start, size))  # type: ignore[union-attr]
+            for idx, off, width in members:
+                values[idx] = self.variables[idx].bytes_to_value(data[off:off + width])
+        for idx in self._single:
+            values[idx] = self.variables[idx].get_value()
+        return values
+
+
+class AcquisitionEngine:
+    """Call ``read`` periodically in a thread and queue ``(time, value)`` pairs.
+
+    The thread is the only user of the link while it runs; stop it before
+    touching the scope from another thread.  When the consumer falls behind
+    the oldest samples are dropped (counted in :attr:`dropped`), so memory is
+    bounded by ``maxsize``.  An exception from ``read`` ends the thread and is
+    kept in :attr:`error`.
+    """
+
+    def __init__(self, read: Callable[[], Any], period_s: float, maxsize: int = 4096) -> None:
+        self.read = read
+        self.period_s = period_s
+        self.dropped = 0
+        self.error: Optional[BaseException] = None
+        self._queue: "queue.Queue[Tuple[float, Any]]" = queue.Queue(maxsize)
+        self._stop = threading.Event()
+        self._thread: Optional[threading.Thread] = None
+
+    @property
+    def running(self) -> bool:
+        """True while the thread exists, including while it is stopping."""
+        if self._thread is not None and not self._thread.is_alive():
+            self._thread = None
+        return self._thread is not None
+
+    def start(self) -> bool:
+        """Start the thread; False if a previous one has not finished yet."""
+        if self.running:
+            return not self._stop.is_set()
+        self.error = None
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+        return True
+
+    def stop(self, timeout: float = 1.0) -> bool:
+        """Ask the thread to end and wait up to ``timeout`` for it.
+
+        Returns False if it is still inside a read (a stalled link); the
+        thread is then kept, so :attr:`running` stays true and :meth:`start`
+        refuses until it has really finished.
+        """
+        self._stop.set()
+        if self._thread is not None:
+            self._thread.join(timeout)
+        return not self.running
+
+    def drain(self) -> List[Tuple[float, Any]]:
+        """All queued samples, oldest first; never blocks."""
+        out = []
+        while True:
+            try:
+                out.append(self._queue.get_nowait())
+            except queue.Empty:
+                return out
+
+    def _put(self, item: Tuple[float, Any]) -> None:
+        while True:
+            try:
+                self._queue.put_nowait(item)
+                return
+            except queue.Full:
+                try:
+                    self._queue.get_nowait()
+                    self.dropped += 1
+                except queue.Empty:
+                    pass
+
+    def _run(self) -> None:
+        next_t = time.perf_counter()
+        while not self._stop.is_set():
+            try:
+                value = self.read()
+            except Exception as e:  # pragma: no cover - link lost
+                self.error = e
+                return
+            self._put((time.perf_counter(), value))
+            next_t += self.period_s
+            delay = next_t - time.perf_counter()
+            if delay > 0:
+                self._stop.wait(delay)
+            else:
+                next_t = time.perf_counter()  # link slower than the period
+
+
+class TriggerCapture:
+    """Host side of the firmware trigger engine in ``main_temp.c``.
+
+    Arm it, poll :meth:`ready` at leisure (the device captures on its own)
+    and :meth:`download` the window once.  Levels for the temperature
+    sources are Q8.8 degrees Celsius (multiply by 256).
+    """
+
+    SOURCE_TEMPERATURE, SOURCE_FILTERED, SOURCE_I2C_ERRORS = range(3)
+    MODE_RISING, MODE_FALLING, MODE_ABOVE, MODE_BELOW, MODE_CHANGE = range(5)
+    STATE_DONE = 4
+    DEPTH = 256                          # TRIGGER_BUFFER_DEPTH in app_config.h
+    SAMPLE = struct.Struct("<HhhH")      # tick, temperatureQ8, filteredQ8, i2cErrors
+
+    def __init__(self, scope: Any, depth: int = DEPTH) -> None:
+        self.depth = depth
+        self._var = {n: scope.get_variable(n) for n in (
+            "triggerSource", "triggerMode", "triggerLevel", "triggerPreSamples",
+            "triggerPrescaler", "triggerArm", "triggerState", "triggerStart")}
+        self._buffer = scope.get_variable("triggerBuffer")
+        if not _supports_block(self._buffer):
+            raise RuntimeError("triggerBuffer cannot be read as a RAM block")
+
+    def arm(self, source: int = SOURCE_TEMPERATURE, mode: int = MODE_RISING,
+            level: int = 0, pre: int = DEPTH // 4, prescaler: int = 1) -> None:
+        for name, value in (("triggerSource", source), ("triggerMode", mode),
+                            ("triggerLevel", level), ("triggerPreSamples", pre),
+                            ("triggerPrescaler", prescaler)):
+            self._var[name].set_value(value)
+        # The firmware takes the arm request on its next 1 ms tick; until then
+        # a previous capture would still read DONE and ready() would return
+        # the old window, so leave DONE first
+        self._var["triggerState"].set_value(0)
+        self._var["triggerArm"].set_value(1)
+
+    def ready(self) -> bool:
+        return int(self._var["triggerState"].get_value()) == self.STATE_DONE
+
+    def download(self) -> List[Tuple[int, int, int, int]]:
+        """The completed window, oldest sample first."""
+        size = self.depth * self.SAMPLE.size
+        base = int(self._buffer.address)
+        data = bytearray()
+        for off in range(0, size, BLOCK_MAX_BYTES):
+            data += bytes(self._buffer.l_net.get_ram(base + off, min(BLOCK_MAX_BYTES, size - off)))
+        samples = [s for s in self.SAMPLE.iter_unpack(bytes(data))]
+        start = int(self._var["triggerStart"].get_value())
+        return samples[start:] + samples[:start]
+
+
+class LogRingReader:
+    """Host side of the ``APP_LOG_BACKEND_RING`` log backend.
+
+    The firmware writes its log (ASCII lines or binary telemetry frames)
+    into ``logRing`` and advances the free-running 16-bit ``logRingHead``.
+    Call :meth:`poll` periodically; it returns the bytes written since the
+    previous call and counts in ``overruns`` the bytes that were
+    overwritten before they could be read.
+    """
+
+    SIZE = 512                           # LOG_RING_SIZE in app_config.h
+
+    def __init__(self, scope: Any, size: int = SIZE) -> None:
+        self.size = size
+        self.overruns = 0
+        self._head = scope.get_variable("logRingHead")
+        self._ring = scope.get_variable("logRing")
+        if self._head is None or not _supports_block(self._ring):
+            raise RuntimeError("firmware not built with the ring log backend")
+        self._last = int(self._head.get_value())
+
+    def _read(self, start: int, count: int) -> bytes:
+        base = int(self._ring.address)
+        data = bytearray()
+        while count:
+            off = start % self.size
+            n = min(count, self.size - off, BLOCK_MAX_BYTES)
+            data += bytes(self._ring.l_net.get_ram(base + off, n))
+            start += n
+            count -= n
+        return bytes(data)
+
+    def poll(self) -> bytes:
+        head = int(self._head.get_value())
+        pending = (head - self._last) & 0xFFFF
+        if pending > self.size:
+            self.overruns += pending - self.size
+            self._last = (head - self.size) & 0xFFFF
+            pending = self.size
+        data = self._read(self._last, pending)
+        # Bytes the firmware overwrote while they were being copied
+        late = (int(self._head.get_value()) - self._last) & 0xFFFF
+        if late > self.size:
+            lost = min(late - self.size, pending)
+            self.overruns += lost
+            data = data[lost:]
+        self._last = head
+        return data
+
+
+class SoakStats:
+    """Host side of the ``stats`` block of ``main_temp.c``.
+
+    The firmware accumulates count, min, max, mean and variance of the
+    primary sensor and of the sampling jitter on every sample, so a soak
+    test only needs a :meth:`read` every minute or so.
+    """
+
+    CHANNELS = ("temperature", "jitter")
+    FIELDS = ("count", "min", "max", "mean", "variance")
+    # Value units: Q8.8 degrees Celsius and RTC ticks (1024 Hz)
+    SCALE = {"temperature": 1 / 256, "jitter": 1 / 1024}
+
+    def __init__(self, scope: Any) -> None:
+        names = [f"stats.{c}.{f}" for c in self.CHANNELS for f in self.FIELDS]
+        variables = [scope.get_variable(n) for n in names]
+        if None in variables:
+            raise RuntimeError("firmware not built with APP_STATS_ENABLE")
+        self._reader = BlockReader(variables)
+        self._reset = scope.get_variable("statsReset")
+
+    def reset(self) -> None:
+        """Start over with the next sample."""
+        self._reset.set_value(1)
+
+    def read(self) -> dict:
+        """``{channel: {count, min, max, mean, std}}`` in °C and seconds."""
+        values = iter(self._reader.read())
+        result = {}
+        for channel in self.CHANNELS:
+            raw = dict(zip(self.FIELDS, (next(values) for _ in self.FIELDS)))
+            k = self.SCALE[channel]
+            result[channel] = {
+                "count": int(raw["count"]),
+                "min": raw["min"] * k,
+                "max": raw["max"] * k,
+                "mean": raw["mean"] / 256 * k,
+                "std": (raw["variance"] / 256) ** 0.5 * k,
+            }
+        return result
+
+
+SETTINGS_SAVE, SETTINGS_DEFAULTS = 1, 2
+SETTINGS_STATUS_BUSY, SETTINGS_STATUS_SAVED, SETTINGS_STATUS_ERROR = 2, 3, 4
+
+
+def commit_settings(scope: Any, defaults: bool = False, timeout_s: float = 2.0) -> int:
+    """Store the current firmware configuration, or restore and store the
+    built-in one with ``defaults=True``.  Returns the record sequence."""
+    command = scope.get_variable("settingsCommand")
+    status = scope.get_variable("settingsStatus")
+    if command is None or status is None:
+        raise RuntimeError("firmware not built with APP_SETTINGS_ENABLE")
+    command.set_value(SETTINGS_DEFAULTS if defaults else SETTINGS_SAVE)
+    deadline = time.monotonic() + timeout_s
+    while True:
+        time.sleep(0.02)
+        # The command is cleared once the commit has started
+        if int(command.get_value()) == 0:
+            state = int(status.get_value())
+            if state == SETTINGS_STATUS_SAVED:
+                return int(scope.get_variable("settingsSequence").get_value())
+            if state == SETTINGS_STATUS_ERROR:
+                raise RuntimeError("settings commit failed, retry to use the next page")
+        if time.monotonic() > deadline:
+            raise TimeoutError("settings commit did not complete")
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Decoder for the binary telemetry frames sent by ``main_temp.c``.
+
+When ``telemetryMode`` is set to ``1`` through X2Cscope the firmware
+replaces the ASCII temperature log on SERCOM1 with fixed 11-byte frames::
+
+    offset  size  field
+    0       1     sync byte 0xA5
+    1       1     sequence number (wraps at 256)
+    2       4     sample time in RTC ticks since start (little endian)
+    6       2     raw sensor word (little endian)
+    8       1     tempSampleRate enumeration
+    9       2     CRC-16/CCITT-FALSE over bytes 1..8 (little endian)
+
+Run the module directly to print decoded frames from a serial port.
+"""
+
+from __future__ import annotations
+
+import argparse
+import struct
+from dataclasses import dataclass
+from typing import Iterator
+
+FRAME_SYNC = 0xA5
+FRAME_SIZE = 11
+RTC_CLOCK_HZ = 1024  # tick rate of the frame timestamp
+_BODY = struct.Struct("<BIHB")  # sequence, timestamp, raw word, rate
+
+
+def crc16_ccitt(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE, matching ``telemetryCrc16`` in the firmware."""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+@dataclass
+class TelemetryFrame:
+    seq: int
+    timestamp: int
+    raw: int
+    rate: int
+
+    @property
+    def temperature(self) -> float:
+        """Temperature in °C with the sensor's 0.5 °C resolution."""
+        raw = self.raw - 0x10000 if self.raw & 0x8000 else self.raw
+        return (raw >> 7) * 0.5
+
+    @property
+    def time_s(self) -> float:
+        """Device sample time in seconds since the RTC was started."""
+        return self.timestamp / RTC_CLOCK_HZ
+
+
+class FrameDecoder:
+    """Incremental decoder; feed it raw bytes as they arrive."""
+
+    def __init__(self) -> None:
+        self._buf = bytearray()
+        self.crc_errors = 0
+        self.lost = 0
+        self._last_seq: int | None = None
+
+    def feed(self, data: bytes) -> Iterator[TelemetryFrame]:
+        self._buf += data
+        while True:
+            start = self._buf.find(FRAME_SYNC)
+            if start < 0:
+                self._buf.clear()
+                return
+            del self._buf[:start]
+            if len(self._buf) < FRAME_SIZE:
+                return
+            body = bytes(self._buf[1:9])
+            (crc,) = struct.unpack_from("<H", self._buf, 9)
+            if crc16_ccitt(body) != crc:
+                # Not a frame boundary (or corrupted): resync past this byte
+                self.crc_errors += 1
+                del self._buf[:1]
+                continue
+            del self._buf[:FRAME_SIZE]
+            frame = TelemetryFrame(*_BODY.unpack(body))
+            if self._last_seq is not None:
+                self.lost += (frame.seq - self._last_seq - 1) & 0xFF
+            self._last_seq = frame.seq
+            yield frame
+
+
+def main() -> None:
+    import serial  # pyserial, installed with pyx2cscope
+
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("port")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    dec = FrameDecoder()
+    with serial.Serial(args.port, args.baud, timeout=0.1) as ser:
+        try:
+            while True:
+                for f in dec.feed(ser.read(256)):
+                    print(f"{f.seq:3d} t={f.time_s:10.3f}s raw=0x{f.raw:04X} "
+                          f"T={f.temperature:6.1f} °C rate={f.rate} lost={dec.lost}")
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == "__main__":
+    main()
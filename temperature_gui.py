@@ -4,7 +4,9 @@
 Connects to a PIC32CM MCU running ``main_temp.c`` and displays two
 variables exposed through the X2Cscope interface:
 ``TemperatureValueX2C`` and ``tempSampleRate``.  A red bar visualises
-the temperature.
+the temperature.  When the firmware exports ``TemperatureTimestampX2C``
+the sample interval is measured from the device's RTC timestamps instead
+of the host clock.
 
 Falls back to a demo mode with synthetic data when ``pyX2Cscope`` is not
 available so the GUI can run without hardware.
@@ -27,6 +29,8 @@ except Exception:  # pragma: no cover - pyX2Cscope missing
 
 import serial.tools.list_ports
 
+from scope_common import AcquisitionEngine, BlockReader, connect_scope
+
 
 # ---------------------------------------------------------------------------
 # Demo backend
@@ -42,14 +46,13 @@ class _DemoSource:
     def __post_init__(self) -> None:
         self.t_last = time.perf_counter()
 
-    def read(self) -> tuple[float, int]:
+    def read(self) -> tuple[float, int, Optional[int]]:
         now = time.perf_counter()
-        dt = now - self.t_last
-        self.t_last = now
         self.temp = 25.0 + 5.0 * math.sin(now)
-        if dt > 1.5:
+        if now - self.t_last > 1.5:
+            self.t_last = now
             self.rate = (self.rate + 1) % 4
-        return self.temp, self.rate
+        return self.temp, self.rate, int(now * RTC_CLOCK_HZ)
 
 
 class _ScopeWrapper:
@@ -60,55 +63,84 @@ class _ScopeWrapper:
         self.scope: Optional[X2CScope] = None
         self.var_temp = None
         self.var_rate = None
+        self.var_stamp = None
+        self._reader: Optional[BlockReader] = None
         self.demo_src = _DemoSource()
 
     def connect(self, port: str, elf: str) -> None:
         if X2CScope is None:
             self.demo = True
             return
-        self.scope = X2CScope(port=port)
-        self.scope.import_variables(elf)
-        self.var_temp = self.scope.get_variable("TemperatureValueX2C")
-        self.var_rate = self.scope.get_variable("tempSampleRate")
+        self.scope = connect_scope(port, elf)
+        block = self._telemetry_vars()
+        if block is not None:
+            # All three live in the telemetry struct: one RAM read per poll
+            self.var_temp, self.var_rate, self.var_stamp = block
+        else:
+            self.var_temp = self.scope.get_variable("TemperatureValueX2C")
+            self.var_rate = self.scope.get_variable("tempSampleRate")
+            self.var_stamp = self._optional_var("TemperatureTimestampX2C")
+        self._reader = BlockReader([self.var_temp, self.var_rate, self.var_stamp])
         self.demo = False
 
+    def _optional_var(self, name: str):
+        """Variable ``name`` or None if the firmware does not export it."""
+        try:
+            return self.scope.get_variable(name)  # type: ignore[union-attr]
+        except Exception:
+            return None
+
+    def _telemetry_vars(self):
+        """Members of the firmware's ``telemetry`` block, if it is present."""
+        names = ("telemetry.temperature", "telemetry.sampleRate", "telemetry.timestamp")
+        block = [self._optional_var(n) for n in names]
+        return None if None in block else block
+
     def disconnect(self) -> None:
         if self.scope is not None:
             self.scope.disconnect()
         self.scope = None
+        self._reader = None
         self.demo = X2CScope is None
 
-    def read(self) -> tuple[float, int]:
-        if self.demo or self.scope is None:
+    def read(self) -> tuple[float, int, Optional[int]]:
+        """Return temperature, rate index and RTC sample time (ticks or None)."""
+        if self.demo or self._reader is None:
             return self.demo_src.read()
-        return (
-            float(self.var_temp.get_value()),  # type: ignore[call-arg]
-            int(self.var_rate.get_value()),  # type: ignore[call-arg]
-        )
+        temp, rate, stamp = self._reader.read()
+        return float(temp), int(rate), None if stamp is None else int(stamp)
 
 
 # ---------------------------------------------------------------------------
 # GUI
 # ---------------------------------------------------------------------------
 
+# Tick rate of the firmware's RTC time base (TemperatureTimestampX2C)
+RTC_CLOCK_HZ = 1024
+
 RATE_LABELS = {
     0: "500 ms",
     1: "1 s",
     2: "2 s",
     3: "4 s",
+    4: "custom",
 }
 
 
 class TemperatureGUI:
-    DT_MS = 200
+    DT_MS = 200         # display refresh
+    ACQ_PERIOD_S = 0.1  # variable poll in the acquisition thread
 
     def __init__(self) -> None:
         self.root = tk.Tk()
         self.root.title("PIC32CM Temperature Monitor")
 
         self._scope = _ScopeWrapper()
+        self._engine = AcquisitionEngine(self._scope.read, self.ACQ_PERIOD_S, maxsize=64)
+        self._latest: Optional[tuple[float, int, Optional[int]]] = None
         self.connected = False
         self._after_id: Optional[str] = None
+        self._last_stamp: Optional[int] = None
 
         self._build_ui()
 
@@ -143,6 +175,9 @@ class TemperatureGUI:
         self.rate_str = tk.StringVar(value="Sample rate: —")
         ttk.Label(disp, textvariable=self.rate_str).pack()
 
+        self.stamp_str = tk.StringVar(value="Sample time: —")
+        ttk.Label(disp, textvariable=self.stamp_str).pack()
+
         self.canvas = tk.Canvas(disp, width=60, height=200, bg="white")
         self.canvas.pack(pady=8)
         self._draw_thermometer(0.0)
@@ -183,12 +218,22 @@ class TemperatureGUI:
         if not port or port == "-" or not elf:
             messagebox.showwarning("Missing", "Choose COM port and ELF file")
             return
+        if self._engine.running:
+            # The previous session's thread is still inside a read
+            messagebox.showwarning("Link busy", "The previous connection is still closing, try again")
+            return
         try:
             self._scope.connect(port, elf)
         except Exception as e:  # pragma: no cover - hardware errors
             messagebox.showerror("Connect", str(e))
             return
         self.connected = True
+        self._last_stamp = None
+        self._latest = None
+        if not self._engine.start():
+            self._disconnect()
+            messagebox.showwarning("Link busy", "The previous connection is still closing, try again")
+            return
         self.conn_btn.config(text="Disconnect")
         self._schedule_update()
 
@@ -196,20 +241,52 @@ class TemperatureGUI:
         if self._after_id is not None:
             self.root.after_cancel(self._after_id)
             self._after_id = None
-        self._scope.disconnect()
         self.connected = False
-        self.conn_btn.config(text="Connect")
+        self.conn_btn.config(text="Connect", state="disabled")
+        self._close_when_idle(timeout=0.2)
+
+    def _close_when_idle(self, timeout: float = 0.0) -> None:
+        """Close the port once the acquisition thread has left its last read."""
+        if not self._engine.stop(timeout):
+            self.root.after(self.DT_MS, self._close_when_idle)
+            return
+        self._scope.disconnect()
+        self.conn_btn.config(state="normal")
 
     # --------------------------------------------------------------- update ---
     def _schedule_update(self) -> None:
         self._after_id = self.root.after(self.DT_MS, self._update)
 
+    def _update_stamp(self, stamp: Optional[int]) -> None:
+        """Show the device sample time and the interval to the previous sample.
+
+        The GUI polls faster than the firmware samples, so an interval is
+        only computed when the timestamp changed.
+        """
+        if stamp is None:
+            self.stamp_str.set("Sample time: n/a")
+            return
+        if self._last_stamp is not None and stamp != self._last_stamp:
+            dt_ms = ((stamp - self._last_stamp) & 0xFFFFFFFF) * 1000.0 / RTC_CLOCK_HZ
+            self.stamp_str.set(f"Sample time: {stamp / RTC_CLOCK_HZ:.3f} s (Δ {dt_ms:.0f} ms)")
+        elif self._last_stamp is None:
+            self.stamp_str.set(f"Sample time: {stamp / RTC_CLOCK_HZ:.3f} s")
+        self._last_stamp = stamp
+
     def _update(self) -> None:
-        temp_c, rate = self._scope.read()
-        temp_f = temp_c * 9.0 / 5.0 + 32.0
-        self.temp_str.set(f"Temperature: {temp_f:.0f} °F")
-        self.rate_str.set(f"Sample rate: {RATE_LABELS.get(rate, rate)}")
-        self._draw_thermometer(temp_c)
+        samples = self._engine.drain()
+        if samples:
+            self._latest = samples[-1][1]
+        if self._latest is not None:
+            temp_c, rate, stamp = self._latest
+            temp_f = temp_c * 9.0 / 5.0 + 32.0
+            self.temp_str.set(f"Temperature: {temp_f:.0f} °F")
+            self.rate_str.set(f"Sample rate: {RATE_LABELS.get(rate, rate)}")
+            self._update_stamp(stamp)
+            self._draw_thermometer(temp_c)
+        if self._engine.error is not None:
+            messagebox.showerror("Connection", f"Acquisition stopped: {self._engine.error}")
+            self._disconnect()
         if self.connected:
             self._schedule_update()
 